@@ -4,6 +4,8 @@
 #include <cxpr.h>
 #include <deque>
 #include <atomic>
+#include <memory_resource>
+#include <stdexcept>
 
 #ifndef PARAM_PACK_UTILS
 #define PARAM_PACK_UTILS
@@ -17,7 +19,10 @@
 #include "flux_allocator.h"
 #include "flux_signal.h"
 #include "flux_callback.h"
+#include "flux_thread_pool.h"
 #include "flux_arena.h"
+#include "flux_snapshot.h"
+#include "flux_persistent.h"
 #include "flux_container.h"
 #include "flux_dispatcher.h"
 #include "flux_context.h"
@@ -56,4 +56,34 @@ namespace cxpr_flux
 		template <typename T>
 		using uniq_ptr = std::unique_ptr<T, _deleter>;
 	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// Payload allocation
+	// Payloads that declare allocator_type = flux_payload_allocator (and the matching
+	// allocator-extended constructors) get it pointed at the dispatcher's signal arena, so 
+	// their dynamic members live and die with the signal. flux_string/flux_vector are the
+	// arena-aware members to build them from.
+	using flux_payload_allocator = std::pmr::polymorphic_allocator<std::byte>;
+	using flux_string = std::pmr::string;
+	template <typename T>
+	using flux_vector = std::pmr::vector<T>;
+
+	// Uses-allocator construction of obj_t from params (std::make_obj_using_allocator minus 
+	// the pair special cases). Types that don't use alloc_t are constructed as usual.
+	template <typename obj_t, typename alloc_t, typename ... params_t>
+	constexpr obj_t make_using_allocator(const alloc_t& alloc, param_pack_t params)
+	{
+		if constexpr (!std::uses_allocator_v<obj_t, alloc_t>)
+		{
+			return obj_t(perfect_forward(params));
+		}
+		else if constexpr (std::is_constructible_v<obj_t, std::allocator_arg_t, const alloc_t&, params_t...>)
+		{
+			return obj_t(std::allocator_arg, alloc, perfect_forward(params));
+		}
+		else
+		{
+			return obj_t(perfect_forward(params), alloc);
+		}
+	}
 }
\ No newline at end of file
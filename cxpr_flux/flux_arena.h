@@ -1,13 +1,29 @@
 #pragma once
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 
 namespace cxpr_flux
 {
+	inline void flux_prefetch(const void* address) noexcept
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+		__builtin_prefetch(address);
+#endif
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// deallactor_entry
+	// Objects that need their destructor run on purge are wrapped in an entry and linked into
+	// a per-type list, the arena knows the type from the list so entries carry no vtable
 	struct deallactor_entry_node
 	{
-		__int64 nextOffset = 0;	// intentionally using offset instead of pointers so we're movable
-		virtual void destruct() = 0;
+		deallactor_entry_node* next = nullptr;	// slabs live on the heap so moving the arena doesn't move entries
 	};
 
 	//////////////////////////////////////////////////////////////////////////
@@ -18,91 +34,164 @@ namespace cxpr_flux
 		template <typename ... params_t>
 		constexpr deallactor_entry(param_pack_t params) : obj(perfect_forward(params)) {}
 
-		virtual void destruct() override { obj.~obj_t(); }
+		// Destroys a whole list of entries holding obj_t
+		static void destroy_list(deallactor_entry_node* node) noexcept
+		{
+			while (node != nullptr)
+			{
+				deallactor_entry_node* next = node->next;
+				if (next != nullptr)
+				{
+					flux_prefetch(next);
+				}
+				static_cast<deallactor_entry*>(node)->obj.~obj_t();
+				node = next;
+			}
+		}
 
 		obj_t obj;
 	};
 
+	//////////////////////////////////////////////////////////////////////////
+	// arena_span
+	// View over a run of objects created by arena_allocator::construct_n. Objects may be
+	// padded out by the arena's bookkeeping so they're addressed by stride, not as an array
+	template <typename obj_t>
+	struct arena_span
+	{
+		obj_t& operator[](size_t index) const { return *reinterpret_cast<obj_t*>(first + index * stride); }
+		size_t size() const { return count; }
+
+		unsigned char* first = nullptr;
+		size_t stride = 0;
+		size_t count = 0;
+	};
+
 	//////////////////////////////////////////////////////////////////////////
 	// arena_allocator
-	// Allocator class that allocates entries within a fixed-size internal buffer
+	// Allocator class that bump allocates entries out of a chain of fixed-size slabs
 	// Allocator explicitly owns all objects allocated with it and will destroy
 	// owned objects on a call to purge. Allocator is expected to be reused 
 	// with usage being similar to:
 	//		do work (alloc entries) -> process work -> purge -> repeat
+	// Slabs are kept across purges, so once the chain has grown to fit a frame's worth of 
+	// work purging only costs the destructors plus one store per slab that was used. Chained
+	// slabs double in size (up to max_slab_sz) so a big frame only costs a handful of them.
+	// Allocation is lock-free: a single fetch_add on the current slab, plus a CAS to move 
+	// everyone on to the next slab once it's full. Small allocations don't even do that, each
+	// thread carves a magazine out of the slab and bumps through it without synchronizing.
+	// purge must not race with allocations.
+	// Destructors are recorded per type, purge runs each type's objects with one call in 
+	// reverse allocation order. There's no ordering between objects of different types.
 	template <typename allocator_t, size_t slab_size = 1024 * 8, bool throwOOM = true>
 	struct arena_allocator
 	{
+	private:
+		// every reservation is rounded up to this, so the head is always aligned for anything up
+		// to min_alignment without having to know where it is before bumping it
+		static constexpr size_t min_alignment = 8;
+
+		// bytes a reservation needs on top of its (rounded) size to be able to align itself
+		static constexpr size_t alignment_slack(size_t alignment) { return alignment > min_alignment ? alignment - min_alignment : 0; }
+		static constexpr size_t reserved_size(size_t sz, size_t alignment) 
+		{ 
+			return ((sz + min_alignment - 1) & ~(min_alignment - 1)) + alignment_slack(alignment);
+		}
+
+		struct alignas(16) slab
+		{
+			std::atomic<slab*> next = nullptr;
+			size_t capacity = 0;			// usable bytes after the header
+			std::atomic<size_t> used = 0;	// high-water mark, the only thing purge has to reset
+
+			unsigned char* memstart() noexcept { return reinterpret_cast<unsigned char*>(this + 1); }
+
+			void* bump(size_t sz, size_t alignment) noexcept
+			{
+				// reserve first and align inside the reservation. If we run off the end the slab
+				// stays overcommitted, which just tells every later caller it's full
+				const size_t reserved = reserved_size(sz, alignment);
+				const size_t offset = used.fetch_add(reserved, std::memory_order_relaxed);
+				if (offset + reserved > capacity)
+				{
+					return nullptr;
+				}
+
+				const uintptr_t head = reinterpret_cast<uintptr_t>(memstart()) + offset;
+				return reinterpret_cast<void*>((head + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+			}
+		};
+
 	public:
 		static constexpr auto max_sz = slab_size;
-		static constexpr auto max_allocation_sz = max_sz;
+		static constexpr auto max_allocation_sz = max_sz - sizeof(slab);
+		static constexpr size_t max_slab_sz = max_sz * 32;
+		static constexpr size_t magazine_sz = max_sz / 16;	// per-thread chunk small allocations are served from
 
 		template <typename obj_t> using allocated_t = obj_t*;
 		using allocator_wrapper_t = stl_allocator_helper<allocator_t>;
 		template <typename T>
 		using uniq_ptr = typename allocator_wrapper_t::template uniq_ptr<T>;
 
-		constexpr arena_allocator(const allocator_t& _alloc = allocator_t{}) noexcept : allocator(_alloc), control{}
-		{
-			control.currentSize = sizeof(control_block);
-		}
+		arena_allocator(const allocator_t& _alloc = allocator_t{}) noexcept 
+			: allocator(_alloc), magazineKey(next_magazine_key()) {}
 
-		constexpr arena_allocator(arena_allocator&& other) noexcept
-			: control{}
+		// magazines handed out by other point into the slabs we take over, so they carry over too
+		arena_allocator(arena_allocator&& other) noexcept
+			: allocator(other.allocator), slabs(other.slabs), currentSlab(other.currentSlab.exchange(nullptr)),
+			overflowHead(other.overflowHead.exchange(nullptr)), oversizedSlabs(other.oversizedSlabs.exchange(nullptr)),
+			magazineKey(other.magazineKey.exchange(next_magazine_key()))
 		{
-			memcpy(_mem, other._mem, max_sz); // this copies the control block also
-			memset(other._mem, 0, max_sz);  // this zeros the size and nulls out control block also 
+			other.slabs = nullptr;
+			for (size_t i = 0; i < max_destructor_types; i++)
+			{
+				destructors[i].typeId.store(other.destructors[i].typeId.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				destructors[i].destroy = other.destructors[i].destroy;
+				destructors[i].head.store(other.destructors[i].head.exchange(nullptr), std::memory_order_relaxed);
+			}
 		}
 
-		//constexpr arena_allocator(arena_allocator&& other) noexcept
-		//	: control{}
-		//{
-		//	memcpy(_mem, other._mem, max_sz); // this copies the control block also
-		//	memset(other._mem, 0, max_sz);  // this zeros the size and nulls out control block also 
-		//}
-
-		~arena_allocator() { purge(); }
+		~arena_allocator() 
+		{ 
+			purge(); 
+			while (slabs != nullptr)
+			{
+				slab* next = slabs->next.load(std::memory_order_relaxed);
+				free_slab(slabs);
+				slabs = next;
+			}
+		}
 
-		constexpr decltype(auto) alloc(size_t sz, const char* tag = nullptr, int alignment = 8)
+		// Allocations bigger than a slab get a dedicated one that's freed again on purge
+		decltype(auto) alloc(size_t sz, const char* tag = nullptr, int alignment = 8)
 		{
-			if(sz <= max_allocation_sz)
+			const size_t reserved = reserved_size(sz, alignment);
+			if (reserved > max_allocation_sz)
 			{
-				const __int64 memEnd = ((__int64)(&control)) + max_sz;
-				const __int64 currentHead = ((__int64)(&control.memstart) + control.currentSize);
-				// calc the span we need to advance to be properly aligned by masking off the bottom bits of the current address
-				const __int64 alignmentOffset = currentHead - (currentHead & (~(alignment - 1)));
-				// generate our new aligned head
-				const __int64 alignedHead = currentHead + alignmentOffset;
-				// adjust size for the alignment changes
-				const __int64 totalSize = sz + alignmentOffset;
-
-				if ((alignedHead + totalSize) < memEnd)
-				{
-					control.currentAllocations++;
-					control.currentSize += static_cast<unsigned int>(totalSize);
-					return reinterpret_cast<void*>(alignedHead);
-				}
-				else
-				{
-					// we're saturated, chain up another allocator to delegate to
-					if (chain == nullptr)
-					{
-						chain = allocator_wrapper_t::template _allocate_one_uniq<arena_allocator>(allocator);
-					}
-
-					return chain->alloc(sz, tag, alignment);
-				}
+				return alloc_oversized(sz, alignment);
 			}
-			else
+			if (reserved > magazine_sz / 4)
 			{
-				throw std::bad_alloc();
+				return alloc_shared(sz, alignment);
+			}
+
+			magazine& local = local_magazine();
+			if (local.cursor + reserved > local.end)
+			{
+				// whatever's left in the old one is wasted until purge
+				local.cursor = reinterpret_cast<uintptr_t>(alloc_shared(magazine_sz, alignof(slab)));
+				local.end = local.cursor + magazine_sz;
 			}
+
+			// the cursor stays min_alignment aligned, so the slack in reserved covers the padding
+			const uintptr_t alignedHead = (local.cursor + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+			local.cursor += reserved;
+			return reinterpret_cast<void*>(alignedHead);
 		}
 
 		template <typename obj_t, typename ... params_t>
 		obj_t* alloc_construct(param_pack_t params)
 		{
-			auto ll = lock.scoped_lock();
 			void* mem = alloc(sizeof(obj_t), "arena", static_cast<int>(std::alignment_of_v<obj_t>));
 			return new(mem) obj_t(perfect_forward(params));
 		}
@@ -112,7 +201,7 @@ namespace cxpr_flux
 		{
 			if constexpr (std::is_trivially_destructible_v<obj_t>)
 			{
-				// type doesnt need to be destructed later, simply zeroing it's mem will suffice
+				// type doesnt need to be destructed later, the slab simply gets reused
 				return alloc_construct<obj_t>(perfect_forward(params));
 			}
 			else
@@ -126,75 +215,398 @@ namespace cxpr_flux
 					return nullptr;
 				}
 
-				auto currentHead = control.currentHeadOffset.load(std::memory_order::memory_order_relaxed);
-				while (true)
+				push_destructors<obj_t>(created, created);
+				return &created->obj;
+			}
+		}
+
+		// Largest number of obj_t a single construct_n call can place in one slab
+		template <typename obj_t>
+		static constexpr size_t max_construct_n()
+		{
+			using stored_t = stored_type_t<obj_t>;
+			return (max_allocation_sz - alignment_slack(alignof(stored_t))) / sizeof(stored_t);
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// construct_n
+		// Constructs count objects back to back in a single allocation, the i'th one built from
+		// generator(i). Destructors (if any) are registered with a single splice, so the whole run
+		// costs one bump + one CAS regardless of count. count must be <= max_construct_n<obj_t>()
+		template <typename obj_t, typename generator_t>
+		arena_span<obj_t> construct_n(const char* tag, size_t count, generator_t&& generator)
+		{
+			using stored_t = stored_type_t<obj_t>;
+			if (count == 0)
+			{
+				return {};
+			}
+			if (count > max_construct_n<obj_t>())
+			{
+				throw std::bad_alloc();
+			}
+
+			stored_t* stored = static_cast<stored_t*>(alloc(sizeof(stored_t) * count, tag, static_cast<int>(alignof(stored_t))));
+
+			size_t nConstructed = 0;
+			try
+			{
+				for (; nConstructed < count; nConstructed++)
 				{
-					__int64 offset = currentHead;
-					__int64 myOffset = ((__int64)created) - ((__int64)(&control.memstart));
-					created->nextOffset = offset;
+					new(&stored[nConstructed]) stored_t(generator(nConstructed));
+				}
+			}
+			catch (...)
+			{
+				// the memory stays with the arena until purge, only unwind what we built
+				while (nConstructed > 0)
+				{
+					stored[--nConstructed].~stored_t();
+				}
+				throw;
+			}
 
-					if (control.currentHeadOffset.compare_exchange_strong(currentHead, myOffset))
-					{
-						break;
-					}
+			arena_span<obj_t> created = {};
+			created.count = count;
+			created.stride = sizeof(stored_t);
+			if constexpr (std::is_trivially_destructible_v<obj_t>)
+			{
+				created.first = reinterpret_cast<unsigned char*>(stored);
+			}
+			else
+			{
+				// link the run newest-first to match construct(), the oldest gets the current head
+				for (size_t i = 1; i < count; i++)
+				{
+					stored[i].next = &stored[i - 1];
 				}
-				
-				return &created->obj;
+				push_destructors<obj_t>(&stored[0], &stored[count - 1]);
+				created.first = reinterpret_cast<unsigned char*>(&stored[0].obj);
 			}
+
+			return created;
 		}
 
 		void purge()
 		{
-			auto ll = lock.scoped_lock();
-			if (control.currentHeadOffset > 0)
+			for (auto& bucket : destructors)
+			{
+				if (bucket.head.load(std::memory_order_relaxed) != nullptr)
+				{
+					bucket.destroy(bucket.head.exchange(nullptr, std::memory_order_acquire));
+				}
+			}
+
+			overflow_entry* overflow = overflowHead.exchange(nullptr, std::memory_order_acquire);
+			while (overflow != nullptr)
 			{
-				deallactor_entry_node* node = reinterpret_cast<deallactor_entry_node*>(
-					((char*)(&control.memstart)) + static_cast<int>(control.currentHeadOffset));
-				while (true)
+				overflow->destroy(overflow->entry);
+				overflow = overflow->next;
+			}
+
+			slab* oversized = oversizedSlabs.exchange(nullptr, std::memory_order_acquire);
+			while (oversized != nullptr)
+			{
+				slab* next = oversized->next.load(std::memory_order_relaxed);
+				free_slab(oversized);
+				oversized = next;
+			}
+
+			// slabs fill front to back, nothing past currentSlab was touched
+			slab* last = currentSlab.load(std::memory_order_relaxed);
+			for (slab* current = slabs; current != nullptr; current = current->next.load(std::memory_order_relaxed))
+			{
+				current->used.store(0, std::memory_order_relaxed);
+				if (current == last)
 				{
-					node->destruct();
-					if (node->nextOffset > 0)
+					break;
+				}
+			}
+			currentSlab.store(slabs, std::memory_order_relaxed);
+			magazineKey.store(next_magazine_key(), std::memory_order_relaxed);	// every thread's magazine is stale now
+		}
+
+		// Total bytes held in slabs, used or not
+		size_t capacity() const noexcept
+		{
+			size_t total = 0;
+			for (const slab* current = slabs; current != nullptr; current = current->next.load(std::memory_order_relaxed))
+			{
+				total += current->capacity;
+			}
+			return total;
+		}
+
+	private:
+		template <typename obj_t>
+		using stored_type_t = std::conditional_t<std::is_trivially_destructible_v<obj_t>, obj_t, deallactor_entry<obj_t>>;
+
+		using slab_allocator_t = typename allocator_wrapper_t::template rebind_alloc_t<slab>;
+
+		// Bumps straight out of the shared slab chain
+		void* alloc_shared(size_t sz, size_t alignment)
+		{
+			if (reserved_size(sz, alignment) > max_allocation_sz)
+			{
+				throw std::bad_alloc();
+			}
+
+			slab* current = currentSlab.load(std::memory_order_acquire);
+			if (current == nullptr)
+			{
+				slab* first = allocate_slab(max_sz);
+				if (currentSlab.compare_exchange_strong(current, first, std::memory_order_acq_rel))
+				{
+					slabs = current = first;
+				}
+				else
+				{
+					free_slab(first);	// someone beat us to it, current now holds theirs
+				}
+			}
+
+			// everything before currentSlab is full, so we only ever look at the tail. Once it's
+			// saturated move on to the next retained slab or chain up a bigger one
+			while (true)
+			{
+				if (void* mem = current->bump(sz, alignment))
+				{
+					return mem;
+				}
+
+				slab* next = current->next.load(std::memory_order_acquire);
+				if (next == nullptr)
+				{
+					const size_t grown = (current->capacity + sizeof(slab)) * 2;
+					slab* chained = allocate_slab(grown < max_slab_sz ? grown : max_slab_sz);
+					if (current->next.compare_exchange_strong(next, chained, std::memory_order_acq_rel))
 					{
-						node = reinterpret_cast<deallactor_entry_node*>(((char*)(&control.memstart)) + node->nextOffset);
+						next = chained;
 					}
 					else
 					{
-						break;
+						free_slab(chained);
 					}
 				}
 
+				// on failure someone already moved the tail on and current is reloaded with it
+				if (currentSlab.compare_exchange_strong(current, next, std::memory_order_acq_rel))
+				{
+					current = next;
+				}
 			}
+		}
 
-			memset(_mem, 0, max_sz); // this zeros the size and nulls out head also 
-			control.currentSize = sizeof(control_block);
-			control.currentAllocations = 0;
+		void* alloc_oversized(size_t sz, size_t alignment)
+		{
+			const size_t slabSize = (reserved_size(sz, alignment) + 2 * sizeof(slab) - 1) / sizeof(slab) * sizeof(slab);
+			slab* dedicated = allocate_slab(slabSize);
+			cas_push(oversizedSlabs, dedicated, dedicated);
+			return dedicated->bump(sz, alignment);
+		}
 
-			if (chain != nullptr)
+		struct magazine
+		{
+			std::uint64_t key = 0;	// magazineKey of the arena + purge it came from
+			uintptr_t cursor = 0;
+			uintptr_t end = 0;
+		};
+
+		// A thread only ever touches a couple of arenas, a few entries is plenty
+		struct magazine_cache
+		{
+			magazine entries[4];
+			unsigned int nextEvicted = 0;
+		};
+
+		magazine& local_magazine() noexcept
+		{
+			static thread_local magazine_cache cache;
+			const std::uint64_t key = magazineKey.load(std::memory_order_relaxed);
+			for (auto& entry : cache.entries)
 			{
-				chain->purge();
+				if (entry.key == key)
+				{
+					return entry;
+				}
 			}
+
+			// keys are never reused, so entries for purged or destroyed arenas just age out
+			magazine& evicted = cache.entries[cache.nextEvicted++ % std::size(cache.entries)];
+			evicted = {};
+			evicted.key = key;
+			return evicted;
 		}
 
-	private:
-		struct control_block
+		static std::uint64_t next_magazine_key() noexcept
 		{
-			std::atomic<__int64> currentHeadOffset = 0;
-			unsigned int currentSize = 0;
-			unsigned int currentAllocations	= 0;
-			unsigned char memstart;
+			static std::atomic<std::uint64_t> nextKey = 1;
+			return nextKey.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// sz includes the header, slabs are allocated in header sized blocks to keep them aligned
+		slab* allocate_slab(size_t sz)
+		{
+			slab_allocator_t rebound = allocator;
+			slab* created = std::allocator_traits<slab_allocator_t>::allocate(rebound, sz / sizeof(slab));
+			new(created) slab();
+			created->capacity = (sz / sizeof(slab) - 1) * sizeof(slab);
+			return created;
+		}
+
+		void free_slab(slab* freed)
+		{
+			slab_allocator_t rebound = allocator;
+			std::allocator_traits<slab_allocator_t>::deallocate(rebound, freed, freed->capacity / sizeof(slab) + 1);
+		}
+
+		using destroy_fn_t = void(*)(deallactor_entry_node*) noexcept;
+
+		struct destructor_bucket
+		{
+			std::atomic<std::uint32_t> typeId = 0;	// 0 while unclaimed, kept across purges
+			destroy_fn_t destroy = nullptr;
+			std::atomic<deallactor_entry_node*> head = nullptr;
 		};
 
-		union 
+		// Only used once every bucket is claimed by another type
+		struct overflow_entry
 		{
-			struct  
-			{
-				allocator_t allocator;
-				flux_spinlock lock;
-				control_block control;
-			};
-			unsigned char __declspec(align(16)) _mem[max_sz];
+			overflow_entry* next = nullptr;
+			destroy_fn_t destroy = nullptr;
+			deallactor_entry_node* entry = nullptr;
 		};
 
-		uniq_ptr<arena_allocator> chain;
+		static constexpr size_t max_destructor_types = 16;
+
+		static std::uint32_t next_destructor_type_id() noexcept
+		{
+			static std::atomic<std::uint32_t> nextId = 1;
+			return nextId.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		template <typename obj_t>
+		static std::uint32_t destructor_type_id() noexcept
+		{
+			static const std::uint32_t id = next_destructor_type_id();
+			return id;
+		}
+
+		template <typename T>
+		static void cas_push(std::atomic<T*>& head, T* oldest, T* newest) noexcept
+		{
+			auto currentHead = head.load(std::memory_order_relaxed);
+			do
+			{
+				oldest->next = currentHead;
+			} while (!head.compare_exchange_weak(currentHead, newest, std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		// Splices an already linked run of entries (oldest .. newest) onto obj_t's destructor list
+		template <typename obj_t>
+		void push_destructors(deallactor_entry_node* oldest, deallactor_entry_node* newest)
+		{
+			const std::uint32_t id = destructor_type_id<obj_t>();
+			for (size_t probe = 0; probe < max_destructor_types; probe++)
+			{
+				destructor_bucket& bucket = destructors[(id + probe) % max_destructor_types];
+				std::uint32_t claimed = bucket.typeId.load(std::memory_order_acquire);
+				if (claimed == 0)
+				{
+					// destroy is only read by purge, which can't overlap with us
+					if (bucket.typeId.compare_exchange_strong(claimed, id, std::memory_order_acq_rel))
+					{
+						bucket.destroy = &deallactor_entry<obj_t>::destroy_list;
+						claimed = id;
+					}
+				}
+
+				if (claimed == id)
+				{
+					cas_push(bucket.head, oldest, newest);
+					return;
+				}
+			}
+
+			// out of buckets, tag the run with its destructor on its own
+			oldest->next = nullptr;
+			overflow_entry* overflow = alloc_construct<overflow_entry>();
+			overflow->destroy = &deallactor_entry<obj_t>::destroy_list;
+			overflow->entry = newest;
+			cas_push(overflowHead, overflow, overflow);
+		}
+
+		allocator_t allocator;
+		slab* slabs = nullptr;						// chain of slabs, kept for reuse across purges
+		std::atomic<slab*> currentSlab = nullptr;	// slab we're bumping out of, everything before it is full
+		destructor_bucket destructors[max_destructor_types];
+		std::atomic<overflow_entry*> overflowHead = nullptr;
+		std::atomic<slab*> oversizedSlabs = nullptr;	// single allocations that didn't fit a slab
+		std::atomic<std::uint64_t> magazineKey = 0;		// changes on every purge, see local_magazine
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// arena_resource
+	// std::pmr::memory_resource over an arena_allocator. Deallocation is a no-op, everything
+	// allocated through it comes back at once when the arena purges, so nothing allocated
+	// from it may outlive the next purge.
+	template <typename arena_t>
+	class arena_resource : public std::pmr::memory_resource
+	{
+	public:
+		explicit arena_resource(arena_t& _arena) noexcept : arena(&_arena) {}
+
+		arena_t& get_arena() const noexcept { return *arena; }
+
+	private:
+		void* do_allocate(size_t bytes, size_t alignment) override
+		{
+			return arena->alloc(bytes, "arena_resource", static_cast<int>(alignment));
+		}
+
+		void do_deallocate(void*, size_t, size_t) override {}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+
+		arena_t* arena;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// arena_stl_allocator
+	// STL allocator over an arena_allocator, the non-virtual counterpart of arena_resource 
+	// with the same rule: deallocate is a no-op and nothing allocated through it may outlive
+	// the next purge. Stateful, but usable as allocator_t for any of the flux types.
+	template <typename T, typename arena_t>
+	struct arena_stl_allocator
+	{
+		using value_type = T;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+
+		template <typename U>
+		struct rebind { using other = arena_stl_allocator<U, arena_t>; };
+
+		arena_stl_allocator(arena_t& _arena) noexcept : arena(&_arena) {}
+
+		template <typename U>
+		arena_stl_allocator(const arena_stl_allocator<U, arena_t>& other) noexcept : arena(other.arena) {}
+
+		T* allocate(size_t n)
+		{
+			return static_cast<T*>(arena->alloc(n * sizeof(T), "arena_stl_allocator", static_cast<int>(alignof(T))));
+		}
+
+		void deallocate(T*, size_t) noexcept {}
+
+		template <typename U>
+		bool operator==(const arena_stl_allocator<U, arena_t>& other) const noexcept { return arena == other.arena; }
+		template <typename U>
+		bool operator!=(const arena_stl_allocator<U, arena_t>& other) const noexcept { return arena != other.arena; }
+
+		arena_t* arena;
 	};
-}
\ No newline at end of file
+}
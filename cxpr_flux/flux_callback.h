@@ -7,50 +7,73 @@
 namespace cxpr_flux
 {
 	// This header implements a type-erased, bound lambda similar to std::function.
-	// bound_function_impl (base interface)
-	// bound_lambda (impl)
+	// callback_thunks (per lambda type invoke/manage functions)
 	// flux_callback (wrapper)
 
 	namespace __detail
 	{
-		template<typename signature_t>
-		struct bound_function_impl;
-
-		template<typename ret_t, typename ... params_t>
-		struct bound_function_impl<ret_t(params_t ...)>
+		enum class callback_op
 		{
-			virtual ~bound_function_impl() = default;
-			virtual ret_t operator()(params_t... p) = 0;
+			copy,	// a precondition failure for move-only lambdas, constructs nothing if checks are off
+			move,	// leaves the source destroyed
+			destroy
 		};
 
 		//////////////////////////////////////////////////////////////////////////
-
+		// The only code that knows the lambda's type. A callback stores pointers to these next
+		// to the lambda instead of a vtable, so a call is a single indirect call.
 		template<typename lambda_t, typename signature_t>
-		struct bound_lambda;
+		struct callback_thunks;
 
 		template<typename lambda_t, typename ret_t, typename ... params_t>
-		struct bound_lambda<lambda_t, ret_t(params_t ...)> : bound_function_impl<ret_t(params_t ...)>
+		struct callback_thunks<lambda_t, ret_t(params_t ...)>
 		{
-			template <typename ll_t>
-			constexpr bound_lambda(ll_t&& lam) : lambda(std::forward<ll_t>(lam)) {}
-			virtual ~bound_lambda() = default;
+			// trivially copyable lambdas (pointers/values only) are copied with a memcpy and
+			// need no manager at all
+			static constexpr bool is_trivial = std::is_trivially_copyable_v<lambda_t> && std::is_trivially_destructible_v<lambda_t>;
 
-			virtual ret_t operator()(params_t... p) override
+			static ret_t invoke(void* storage, params_t... p)
 			{
-				return lambda(perfect_forward(p));
+				return (*static_cast<lambda_t*>(storage))(perfect_forward(p));
 			}
 
-		private:
-			lambda_t lambda;
+			// false if dst was left unconstructed
+			static bool manage(callback_op op, void* dst, void* src) noexcept
+			{
+				switch (op)
+				{
+				case callback_op::copy:
+					if constexpr (std::is_copy_constructible_v<lambda_t>)
+					{
+						new (dst) lambda_t(*static_cast<const lambda_t*>(src));
+					}
+					else
+					{
+						precondition_check(!"copying a callback bound to a move-only lambda");
+						return false;
+					}
+					break;
+				case callback_op::move:
+					new (dst) lambda_t(std::move(*static_cast<lambda_t*>(src)));
+					static_cast<lambda_t*>(src)->~lambda_t();
+					break;
+				case callback_op::destroy:
+					static_cast<lambda_t*>(dst)->~lambda_t();
+					break;
+				}
+				return true;
+			}
 		};
 	}
 
 	//////////////////////////////////////////////////////////////////////////
 	// flux_callback
 	// Wrapper class that implements a type-erased callable for a lambda matching the signature:  ret_t(params_t ...)
-	// When bind_lambda is called, the proper derived type (bound_lambda<ret_t(params_t ...)>) is allocated
-	// within the internal buffer of the callback. Note: this callback + it's captures must be <= the size of 
-	// the internal buffer or it'll throw a compiler error.
+	// When bind_lambda is called, the lambda is stored within the internal buffer of the callback along with 
+	// an invoke thunk (and a manage thunk for copying/destroying it if it isn't trivially copyable). 
+	// Copying a callback bound to a move-only lambda is a precondition failure, if checks are
+	// compiled out the copy is left empty rather than pointing at an unconstructed lambda.
+	// Note: the lambda + it's captures must fit within capture_size minus a pointer, or it'll throw a compiler error.
 	template<size_t capture_size, typename signature_t>
 	struct flux_callback_base;
 
@@ -59,163 +82,174 @@ namespace cxpr_flux
 	{
 	public:
 		using my_t = flux_callback_base<capture_size, ret_t(params_t ...)>;
-		static constexpr int sentinel_value = 1234567;
 
-		constexpr flux_callback_base() noexcept : impl(nullptr), inline_mem{}, sentinel{ sentinel_value }{}
+		constexpr flux_callback_base() noexcept = default;
 		~flux_callback_base()
 		{
-			if (impl != nullptr)
-			{
-				impl->~internal_t();
-			}
+			reset();
 		}
 
-		constexpr flux_callback_base(const my_t& other) noexcept
+		flux_callback_base(const my_t& other) noexcept
 		{
 			assign(other);
 		}
 
 		flux_callback_base& operator=(const my_t& other) noexcept
 		{
-			assign(other);
-			return *this;
-		}
-
-		void assign(const my_t& other)
-		{
-			sentinel = other.sentinel;
-			precondition_check(sentinel == sentinel_value);
-			if (impl != nullptr)
+			if (this != &other)
 			{
-				impl->~internal_t();
-			}
-			if (other.impl != nullptr)
-			{
-				__int64 offset = ((char*)other.impl) - ((char*)other.inline_mem);
-				memcpy(inline_mem, other.inline_mem, sizeof(inline_mem));
-				impl = (internal_t*)(inline_mem + offset);
+				reset();
+				assign(other);
 			}
+			return *this;
 		}
 
-		constexpr flux_callback_base(my_t&& other) noexcept
+		flux_callback_base(my_t&& other) noexcept
 		{
-			sentinel = other.sentinel;
 			move_impl(std::move(other));
 		}
 
-		constexpr my_t& operator=(my_t&& other) noexcept
+		my_t& operator=(my_t&& other) noexcept
 		{
-			sentinel = other.sentinel;
-			move_impl(std::move(other));
+			if (this != &other)
+			{
+				reset();
+				move_impl(std::move(other));
+			}
 			return *this;
 		}
 		
-		// Invokes the wrapped function and returns the result in std::optional<ret_t>
+		// Invokes the wrapped function, non-void results are returned in a std::optional<ret_t>
+		// that's empty if nothing is bound
 		template <typename ... Ts>
-		decltype(auto) operator()(Ts&&... p)
+		decltype(auto) operator()(Ts&&... p) const
 		{
+			auto storage = const_cast<char*>(inline_mem);
 			if constexpr (std::is_same_v<ret_t, void>)
 			{
-				// void return, no optional
-				if (impl != nullptr)
+				if (invoker != nullptr)
 				{
-					(*(impl))(perfect_forward(p));
+					invoker(storage, perfect_forward(p));
 				}
 			}
 			else
 			{
-				// non-void return, no optional
-				if (impl != nullptr)
+				if (invoker != nullptr)
 				{
-					return (*(impl))(perfect_forward(p));
+					return std::optional<ret_t>(invoker(storage, perfect_forward(p)));
 				}
 
 				return std::optional<ret_t>{};
 			}
 		}
 
-		template <typename ... Ts>
-		decltype(auto) operator()(Ts&&... p) const 
+		template <typename lambda_t>
+		void bind_lambda(lambda_t&& lam)
 		{
-			if constexpr (std::is_same_v<ret_t, void>)
-			{
-				// void return, no optional
-				if (impl != nullptr)
-				{
-					(*(impl))(perfect_forward(p));
-				}
-			}
-			else
-			{
-				// non-void return, no optional
-				if (impl != nullptr)
-				{
-					return (*(impl))(perfect_forward(p));
-				}
-
-				return std::optional<ret_t>{};
-			}
+			using decayed_t = std::decay_t<lambda_t>;
+			using thunks_t = __detail::callback_thunks<decayed_t, ret_t(params_t ...)>;
+			static_assert(bound_payload_size<decayed_t>() <= max_internal_sz, "lambda is too large, reduce capture list");
+			static_assert(alignof(decayed_t) <= alignof(void*), "lambda is over-aligned for the internal buffer");
+
+			reset();
+			new (inline_mem) decayed_t(std::forward<lambda_t>(lam));
+			invoker = &thunks_t::invoke;
+			manager = thunks_t::is_trivial ? nullptr : &thunks_t::manage;
 		}
 
 		template <typename lambda_t>
-		decltype(auto) bind_lambda(lambda_t&& lam)
-		{
-			precondition_check(sentinel == sentinel_value);
-			auto offset = (__int64)(inline_mem) % std::alignment_of_v<lambda_t>;
-			auto sz = sizeof(__detail::bound_lambda<lambda_t, ret_t(params_t ...)>);
-			static_assert(bound_payload_size<lambda_t>() <= max_internal_sz, "lambda is too large, reduce capture list");
-			impl = new (inline_mem) __detail::bound_lambda<lambda_t, ret_t(params_t ...)>(std::forward<lambda_t>(lam));
-			precondition_check(sentinel == sentinel_value);
-			return impl;
-		}
+		static constexpr size_t bound_payload_size() { return sizeof(lambda_t); };
 
-		template <typename obj_t, typename functor_t, typename ... params_t>
-		decltype(auto) bind_member(obj_t& obj, functor_t& fun, params_t&&... params)
-		{
-			precondition_check(sentinel == sentinel_value);
-			precondition_check(sentinel == sentinel_value);
-			return impl;
-		}
+		constexpr operator bool() const { return invoker != nullptr; }
 
+	private:
+		using invoke_fn_t = ret_t(*)(void* storage, params_t... p);
+		using manage_fn_t = bool(*)(__detail::callback_op op, void* dst, void* src) noexcept;
 
-		template <typename lambda_t>
-		static constexpr size_t bound_payload_size() { return sizeof(__detail::bound_lambda<lambda_t, ret_t(params_t ...)>); };
+		// capture_size used to include bound_lambda's vptr, the thunks take its place so the
+		// same lambdas fit and the whole callback is 2 pointers + the lambda
+		static constexpr size_t max_internal_sz = capture_size - sizeof(void*);
 
-		constexpr operator bool() const { return impl != nullptr; }
+		void reset() noexcept
+		{
+			if (manager != nullptr)
+			{
+				manager(__detail::callback_op::destroy, inline_mem, nullptr);
+			}
+			invoker = nullptr;
+			manager = nullptr;
+		}
 
-	private:
-		static constexpr size_t max_internal_sz = capture_size; // 24 + 8 = 32, which is a nicely aligned size
-		using internal_t = __detail::bound_function_impl<ret_t(params_t ...)>;
+		// expects this to be empty, stays empty if other is bound to a move-only lambda
+		void assign(const my_t& other) noexcept
+		{
+			if (other.manager != nullptr)
+			{
+				if (!other.manager(__detail::callback_op::copy, inline_mem, const_cast<char*>(other.inline_mem)))
+				{
+					return;
+				}
+			}
+			else if (other.invoker != nullptr)
+			{
+				memcpy(inline_mem, other.inline_mem, sizeof(inline_mem));
+			}
+			invoker = other.invoker;
+			manager = other.manager;
+		}
 
-		void move_impl(my_t&& other)
+		// expects this to be empty, leaves other empty
+		void move_impl(my_t&& other) noexcept
 		{
-			if (other.impl != nullptr)
+			if (other.manager != nullptr)
+			{
+				other.manager(__detail::callback_op::move, inline_mem, other.inline_mem);
+			}
+			else if (other.invoker != nullptr)
 			{
-				__int64 offset = ((char*)other.impl) - ((char*)other.inline_mem);
 				memcpy(inline_mem, other.inline_mem, sizeof(inline_mem));
-				impl = (internal_t*)(inline_mem + offset);
-				other.impl = nullptr;
 			}
+			invoker = std::exchange(other.invoker, nullptr);
+			manager = std::exchange(other.manager, nullptr);
 		}
 
-		internal_t* impl = nullptr;
-		alignas(std::alignment_of_v<internal_t>) char inline_mem[max_internal_sz];
-		int sentinel;
+		invoke_fn_t invoker = nullptr;
+		manage_fn_t manager = nullptr;
+		alignas(void*) char inline_mem[max_internal_sz] = {};
 	};
 
-	static constexpr size_t small_callback_size = 24;	// 32 bit total size
+	static constexpr size_t small_callback_size = 24;	// 32 byte total size
 	static constexpr size_t big_callback_size = 104;
 
-	template <typename sig_t> // 32 bit total size
+	template <typename sig_t> // 32 byte total size
 	using flux_callback = flux_callback_base<small_callback_size, sig_t>;
 
-	template <typename sig_t>  // 128 bit total size
+	template <typename sig_t>  // 112 byte total size
 	using flux_big_callback = flux_callback_base<big_callback_size, sig_t>;
 
 
+	//////////////////////////////////////////////////////////////////////////
+	// flux_callback_handle
+	// Identifies a callback registered with a callback_list so it can be removed again. 
+	// Handles to callbacks that are already gone are ignored.
+	struct flux_callback_handle
+	{
+		static constexpr std::uint32_t invalid_slot = ~std::uint32_t(0);
+
+		std::uint32_t slot = invalid_slot;
+		std::uint32_t generation = 0;
+
+		constexpr bool valid() const noexcept { return slot != invalid_slot; }
+	};
+
 	//////////////////////////////////////////////////////////////////////////
 	// callback_list
-	// Wrapper for a vector of callbacks. All callbacks will be invoked on a call to ()
+	// Slot map of callbacks. All callbacks are invoked in registration order on a call to call().
+	// Callbacks are stored flat; handles point at them through a slot with a generation, so
+	// removal is O(1): the entry is tombstoned and the list compacted once half of it is dead.
+	// The list can be changed from inside its own callbacks. Removed callbacks (including the 
+	// one running) stop being called right away but are only destroyed once the outermost 
+	// call returns, and callbacks registered during a call are first called by the next one.
 	template <size_t lambda_size, typename sig_t, typename allocator_t = std::allocator<void>>
 	class callback_list_base
 	{
@@ -227,53 +261,218 @@ namespace cxpr_flux
 		using callback_t = flux_callback_base<lambda_size, sig_t>;
 
 		constexpr callback_list_base() = default;
+		explicit callback_list_base(const allocator_t& allocator) 
+			: callbacks(allocator), pending(allocator), slots(allocator), freeSlots(allocator) {}
 		~callback_list_base() = default;
 
 		constexpr callback_list_base(callback_list_base&& other) noexcept 
-			: callbacks(std::move(other.callbacks)) {}
+			: callbacks(std::move(other.callbacks)), pending(std::move(other.pending)), slots(std::move(other.slots)),
+			freeSlots(std::move(other.freeSlots)), nLive(std::exchange(other.nLive, 0)), nDead(std::exchange(other.nDead, 0)) {}
 		callback_list_base& operator=(callback_list_base&& other) noexcept 
-		{ callbacks = std::move(other.callbacks); return *this; }
+		{
+			callbacks = std::move(other.callbacks);
+			pending = std::move(other.pending);
+			slots = std::move(other.slots);
+			freeSlots = std::move(other.freeSlots);
+			nLive = std::exchange(other.nLive, 0);
+			nDead = std::exchange(other.nDead, 0);
+			return *this; 
+		}
 
 		template <typename lambda_t>
-		void registerCallback(void* owner, lambda_t&& lam)
+		flux_callback_handle registerCallback(void* owner, lambda_t&& lam)
 		{
 			using decayed_t = std::decay_t<lambda_t>;
+			const flux_callback_handle handle = allocate_slot();
+			// mid-call the list can't grow under the running callbacks, park new ones until it's done
+			auto& list = (callDepth > 0) ? pending : callbacks;
+			slots[handle.slot].position = static_cast<std::uint32_t>(callbacks.size() + ((callDepth > 0) ? pending.size() : 0));
 			if constexpr (std::is_same_v<decayed_t, callback_t>)
 			{	// no need to wrap, already wrapped in a flux_callback
-				callbacks.emplace_back(std::make_pair(owner, std::forward<lambda_t>(lam)));
+				list.push_back(entry{ owner, handle.slot, std::forward<lambda_t>(lam) });
 			}
 			else
-			{	// naked lambda, need to wrap to stor
-				callbacks.emplace_back(std::make_pair(owner, callback_t()))
-					.second.bind_lambda(std::forward<lambda_t>(lam));
+			{	// naked lambda, need to wrap to store
+				list.push_back(entry{ owner, handle.slot, callback_t() });
+				list.back().callback.bind_lambda(std::forward<lambda_t>(lam));
 			}
+			nLive++;
+			return handle;
 		}
 
-		template <typename ...  Ts>
-		constexpr void call(Ts&& ... params) noexcept
+		// Removes the callback handle was returned for, false if it's already gone
+		bool removeCallback(flux_callback_handle handle)
+		{
+			if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation)
+			{
+				return false;
+			}
+
+			const std::uint32_t position = slots[handle.slot].position;
+			if (position < callbacks.size())
+			{
+				kill(callbacks[position], true);
+			}
+			else
+			{
+				kill(pending[position - callbacks.size()], false);
+			}
+			compact_if_sparse();
+			return true;
+		}
+
+		// Removes every callback registered for owner
+		void clearCallback(void* owner)
 		{
 			for (auto& it : callbacks)
 			{
-				it.second(perfect_forward(params));
+				if (it.slot != dead_slot && it.owner == owner)
+				{
+					kill(it, true);
+				}
+			}
+			for (auto& it : pending)
+			{
+				if (it.slot != dead_slot && it.owner == owner)
+				{
+					kill(it, false);
+				}
 			}
+			compact_if_sparse();
 		}
 
-		constexpr void clearCallback(void* owner)
+		template <typename ...  Ts>
+		constexpr void call(Ts&& ... params) noexcept
 		{
-			if (callbacks.size() > 0)
+			callDepth++;
+			// by index, only the callbacks that were there when the call started
+			const size_t nCallbacks = callbacks.size();
+			for (size_t i = 0; i < nCallbacks; i++)
 			{
-				callbacks.erase(std::find_if(std::begin(callbacks), std::end(callbacks),
-					[&](const auto& entry)
+				if (callbacks[i].slot != dead_slot)
 				{
-					return entry.first == owner;
-				}));
+					callbacks[i].callback(params...);
+				}
+			}
+
+			if (--callDepth == 0)
+			{
+				settle();
 			}
 		}
 
+		size_t size() const noexcept { return nLive; }
+		bool empty() const noexcept { return nLive == 0; }
+
 	private:
-		using entry_pair = std::pair<void*, callback_t>;
+		static constexpr std::uint32_t dead_slot = flux_callback_handle::invalid_slot;
+
+		struct entry
+		{
+			void* owner;
+			std::uint32_t slot; // dead_slot once removed
+			callback_t callback;
+		};
+
+		struct slot_t
+		{
+			std::uint32_t position; // into callbacks, then pending
+			std::uint32_t generation;
+		};
+
+		flux_callback_handle allocate_slot()
+		{
+			if (freeSlots.empty())
+			{
+				slots.push_back(slot_t{ 0, 0 });
+				return { static_cast<std::uint32_t>(slots.size() - 1), 0 };
+			}
+
+			const std::uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+			return { slot, slots[slot].generation };
+		}
+
+		void kill(entry& removed, bool isListed)
+		{
+			// bumping the generation invalidates every handle to it, the slot can be reused 
+			slots[removed.slot].generation++;
+			freeSlots.push_back(removed.slot);
+			removed.slot = dead_slot;
+			nLive--;
+			nDead += isListed ? 1 : 0; // pending ones are just dropped when they'd be listed
+
+			if (callDepth == 0)
+			{
+				removed.callback = callback_t();
+			}
+			else
+			{
+				nKilledDuringCall++;
+			}
+		}
+
+		// runs once the outermost call returns
+		void settle()
+		{
+			for (auto& added : pending)
+			{
+				if (added.slot != dead_slot)
+				{
+					slots[added.slot].position = static_cast<std::uint32_t>(callbacks.size());
+					callbacks.push_back(std::move(added));
+				}
+			}
+			pending.clear();
+
+			if (nKilledDuringCall > 0)
+			{
+				// nothing can be running anymore, let go of the captures
+				for (auto& it : callbacks)
+				{
+					if (it.slot == dead_slot)
+					{
+						it.callback = callback_t();
+					}
+				}
+				nKilledDuringCall = 0;
+			}
+			compact_if_sparse();
+		}
+
+		void compact_if_sparse()
+		{
+			if (callDepth > 0 || nDead == 0 || nDead * 2 < callbacks.size())
+			{
+				return;
+			}
+
+			// stable, keeps the call order
+			size_t nKept = 0;
+			for (size_t i = 0; i < callbacks.size(); i++)
+			{
+				if (callbacks[i].slot != dead_slot)
+				{
+					if (nKept != i)
+					{
+						callbacks[nKept] = std::move(callbacks[i]);
+					}
+					slots[callbacks[nKept].slot].position = static_cast<std::uint32_t>(nKept);
+					nKept++;
+				}
+			}
+			callbacks.erase(std::begin(callbacks) + nKept, std::end(callbacks));
+			nDead = 0;
+		}
 
-		std::vector<entry_pair, rebind_alloc_t<entry_pair>> callbacks;
+		std::vector<entry, rebind_alloc_t<entry>> callbacks;
+		std::vector<entry, rebind_alloc_t<entry>> pending; // registered during a call
+		std::vector<slot_t, rebind_alloc_t<slot_t>> slots;
+		std::vector<std::uint32_t, rebind_alloc_t<std::uint32_t>> freeSlots;
+		size_t nLive = 0;
+		size_t nDead = 0; // tombstones in callbacks
+		size_t nKilledDuringCall = 0;
+		int callDepth = 0;
 	};
 
 	template <typename sig_t>
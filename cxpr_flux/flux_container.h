@@ -6,15 +6,51 @@ namespace cxpr_flux
 {
 	namespace __detail
 	{
+		//////////////////////////////////////////////////////////////////////////
+		// States that can list what changed between two of their versions (the persistent
+		// containers) get diffed, anything else can only report that it changed at all.
+		template <typename state_t, typename = void>
+		struct state_changes
+		{
+			static constexpr bool diffable = false;
+			using changeset_t = flux_changeset<size_t>;
+		};
+
+		template <typename state_t>
+		struct state_changes<state_t, std::void_t<typename state_t::changeset_t>>
+		{
+			static constexpr bool diffable = true;
+			using changeset_t = typename state_t::changeset_t;
+		};
+
+		template <typename store_t>
+		using store_changeset_t = typename state_changes<published_state_t<store_t>>::changeset_t;
+
+		//////////////////////////////////////////////////////////////////////////
+		// What a container last handed out of a store's state, the baseline for getChanges.
+		// Only diffable states keep a copy, which is a shared version rather than a deep copy.
+		template <typename store_t>
+		struct seen_state
+		{
+			struct nothing_kept {};
+			using state_t = published_state_t<store_t>;
+			using changes_t = state_changes<state_t>;
+
+			std::conditional_t<changes_t::diffable, state_t, nothing_kept> state = {};
+			bool pending = false; // the store changed since
+		};
+
 		//////////////////////////////////////////////////////////////////////////
 		// Internal state for a container. Must be heap-allocated so that if the container
-		// is moved the bound lambdas don't lose a good this capture
+		// is moved the bound lambdas don't lose a good this capture. Holds whatever the stores
+		// publish, stores handing out flux_snapshots are shared rather than copied.
 		template <typename ... Ts>
 		struct flux_container_state
 		{
 			bool isDirty = false;
 			bool isReady = false;
-			std::tuple<typename Ts::state_t...> states = {};
+			std::tuple<published_state_t<Ts>...> states = {};
+			std::tuple<seen_state<Ts>...> seen = {};
 
 			template <typename ... Ts>
 			flux_container_state(Ts&&... stores) : states{}
@@ -23,8 +59,9 @@ namespace cxpr_flux
 				(stores.addListener(this, [this](const auto& newState)
 				{
 					isReady = true;
-					using payload_t = typename std::decay_t<decltype(newState)>::state_t;
+					using payload_t = published_state_t<std::decay_t<decltype(newState)>>;
 					cxpr::first_match<payload_t>(states) = newState.getState();
+					cxpr::first_match<seen_state<std::decay_t<decltype(newState)>>>(seen).pending = true;
 					isDirty = true;
 					onChanged.call();
 				}), ...);
@@ -63,7 +100,48 @@ namespace cxpr_flux
 		template <typename store_t>
 		const typename store_t::state_t& getState() const {
 			// fetches the current state out of the state tuple
-			return cxpr::first_match<typename store_t::state_t>(state->states);
+			return __detail::unwrap_state(getSnapshot<store_t>());
+		}
+
+		// The state exactly as the store published it, i.e. a flux_snapshot for stores that
+		// publish them. Copy it to share the state without copying it.
+		template <typename store_t>
+		const __detail::published_state_t<store_t>& getSnapshot() const {
+			return cxpr::first_match<__detail::published_state_t<store_t>>(state->states);
+		}
+
+		// What changed in store_t's state since the last resetChanges, so views can patch
+		// themselves instead of rebuilding. Keyed like the state for the persistent containers,
+		// any other state just reports reset whenever the store changed.
+		template <typename store_t>
+		__detail::store_changeset_t<store_t> getChanges() const {
+			using seen_t = __detail::seen_state<store_t>;
+			const seen_t& seen = cxpr::first_match<seen_t>(state->seen);
+			__detail::store_changeset_t<store_t> changes;
+			if constexpr (seen_t::changes_t::diffable)
+			{
+				if (seen.pending)
+				{
+					getSnapshot<store_t>().collect_changes(seen.state, changes);
+				}
+			}
+			else
+			{
+				changes.reset = seen.pending;
+			}
+			return changes;
+		}
+
+		// Makes the current state the baseline for getChanges
+		template <typename store_t>
+		void resetChanges() {
+			using seen_t = __detail::seen_state<store_t>;
+			seen_t& seen = cxpr::first_match<seen_t>(state->seen);
+			if constexpr (seen_t::changes_t::diffable)
+			{
+				seen.state = getSnapshot<store_t>();
+			}
+			seen.pending = false;
 		}
 
 		bool isReady() const {
@@ -72,12 +150,17 @@ namespace cxpr_flux
 
 
 		template <typename functor_t>
-		void addListener(void* owner, functor_t&& fun) const noexcept
+		flux_callback_handle addListener(void* owner, functor_t&& fun) const
+		{
+			return state->onChanged.registerCallback(owner, std::forward<functor_t>(fun));
+		}
+
+		bool removeListener(flux_callback_handle handle) const
 		{
-			state->onChanged.registerCallback(owner, std::forward<functor_t>(fun));
+			return state->onChanged.removeCallback(handle);
 		}
 
-		bool getResetDirty() { auto dirty = state->isDirty;  state->isDirty = false; }
+		bool getResetDirty() { auto dirty = state->isDirty;  state->isDirty = false; return dirty; }
 
 		std::unique_ptr<state_t> state;
 	};
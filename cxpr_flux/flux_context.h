@@ -1,9 +1,67 @@
 #pragma once
 
+#include <array>
+#include <unordered_map>
+
 //////////////////////////////////////////////////////////////////////////
 
 namespace cxpr_flux
 {
+	//////////////////////////////////////////////////////////////////////////
+	// flux_change_batch
+	// Collects the emitChanged calls stores make on this thread while the batch is active, so 
+	// each store notifies its listeners once when the batch is flushed instead of once per
+	// change. Contexts activate one around every processSignals pass and flush it after the
+	// drain, which keeps listener work per frame proportional to the stores that changed 
+	// rather than to the signals they handled. Outside of a batch emitChanged notifies
+	// immediately.
+	class flux_change_batch
+	{
+	public:
+		using flush_fn_t = void(*)(void* store);
+
+		flux_change_batch() = default;
+		flux_change_batch(flux_change_batch&& other) noexcept = default;
+		flux_change_batch& operator=(flux_change_batch&& other) noexcept = default;
+
+		// Makes this the batch for the calling thread until the returned guard goes away
+		[[nodiscard]] decltype(auto) activate() noexcept
+		{
+			struct scoped_activation
+			{
+				flux_change_batch* previous;
+				~scoped_activation() { active() = previous; }
+			};
+			return scoped_activation{ std::exchange(active(), this) };
+		}
+
+		static flux_change_batch* current() noexcept { return active(); }
+
+		void defer(void* store, flush_fn_t flush) { pending.emplace_back(store, flush); }
+
+		bool empty() const noexcept { return pending.empty(); }
+
+		// Notifies every store deferred so far, in the order they first changed. Stores 
+		// dirtied by the listeners themselves are picked up by the same flush.
+		void flush()
+		{
+			for (size_t i = 0; i < pending.size(); i++)
+			{
+				pending[i].second(pending[i].first);
+			}
+			pending.clear(); // keeps the capacity, steady-state passes don't allocate
+		}
+
+	private:
+		static flux_change_batch*& active() noexcept
+		{
+			static thread_local flux_change_batch* batch = nullptr;
+			return batch;
+		}
+
+		std::vector<std::pair<void*, flush_fn_t>> pending;
+	};
+
 	//////////////////////////////////////////////////////////////////////////
 
 	template <typename derived_t>
@@ -20,21 +78,75 @@ namespace cxpr_flux
 		}
 
 		template <typename functor_t>
-		void addListener(void* owner, functor_t&& fun) const noexcept
+		flux_callback_handle addListener(void* owner, functor_t&& fun) const
 		{
-			onChanged.registerCallback(owner, std::forward<functor_t>(fun));
+			return onChanged.registerCallback(owner, std::forward<functor_t>(fun));
+		}
+
+		bool removeListener(flux_callback_handle handle) const
+		{
+			return onChanged.removeCallback(handle);
 		}
 
 	protected:
+		// Notifies listeners, or just marks the store dirty if a flux_change_batch is active,
+		// in which case listeners hear about it once when the batch is flushed.
 		void emitChanged()
 		{
+			if (flux_change_batch* batch = flux_change_batch::current())
+			{
+				if (!changePending)
+				{
+					changePending = true;
+					batch->defer(this, &flush_changes);
+				}
+				return;
+			}
 			onChanged.call(static_cast<derived_t&>(*this));
 		}
 
 	private:
+		static void flush_changes(void* store)
+		{
+			auto& self = *static_cast<flux_store*>(store);
+			self.changePending = false;
+			self.onChanged.call(static_cast<derived_t&>(self));
+		}
+
 		mutable callback_list<void(const derived_t&)> onChanged;
+		bool changePending = false;
 	};	
 
+	//////////////////////////////////////////////////////////////////////////
+	// Routing keys
+	// A payload and a store that both expose a const routingKey() member are "keyed": the
+	// store facade indexes its instances by key, and a keyed signal is delivered only to the
+	// instance whose key matches instead of being broadcast to every instance. A store's key 
+	// is read once when it's created and must not change afterwards, and must be unique within
+	// its store type. Signals without a key are still broadcast to keyed stores.
+	namespace __detail
+	{
+		template <typename T, typename = void>
+		struct routing_key
+		{
+			static constexpr bool value = false;
+			using type = int;
+		};
+
+		template <typename T>
+		struct routing_key<T, std::void_t<decltype(std::declval<const T&>().routingKey())>>
+		{
+			static constexpr bool value = true;
+			using type = std::decay_t<decltype(std::declval<const T&>().routingKey())>;
+		};
+	}
+
+	template <typename T>
+	static constexpr bool has_routing_key_v = __detail::routing_key<T>::value;
+
+	template <typename T>
+	using routing_key_t = typename __detail::routing_key<T>::type;
+
 	//////////////////////////////////////////////////////////////////////////
 
 	template <typename _store_t, typename context_t>
@@ -45,18 +157,30 @@ namespace cxpr_flux
 		using allocator_t = typename context_t::allocator_t;
 		using callbacks_t = decltype(store_t::GetCallbacks());
 		static constexpr callbacks_t callbacks = store_t::GetCallbacks();
+		static constexpr bool is_keyed = has_routing_key_v<store_t>;
 
 		template <typename T>
 		using rebind_alloc_t =
 			typename std::allocator_traits<allocator_t>::template rebind_alloc<T>;
 
+		using key_t = routing_key_t<store_t>;
+		using key_index_t = std::unordered_map<key_t, size_t, std::hash<key_t>, std::equal_to<key_t>, 
+			rebind_alloc_t<std::pair<const key_t, size_t>>>;
+
 		constexpr flux_store_facade(context_t& _ctx, const allocator_t& _allocator) noexcept
-			: context(_ctx), allocator(_allocator), stores(allocator) {}
+			: context(_ctx), allocator(_allocator), stores(allocator), keyIndex(allocator), 
+			onCreateCbs(allocator), onDestroyCbs(allocator) {}
 
 		template <typename ... params_t>
 		constexpr store_t* CreateStore(param_pack_t params)
 		{
 			auto& emplaced = stores.emplace_back(perfect_forward(params));
+			if constexpr (is_keyed)
+			{
+				// one store per key, the key routes signals to it
+				const bool isNewKey = keyIndex.try_emplace(emplaced.routingKey(), stores.size() - 1).second;
+				precondition_check(isNewKey);
+			}
 			onCreateCbs.call(emplaced, context);
 			return &emplaced;
 		}
@@ -64,25 +188,84 @@ namespace cxpr_flux
 		constexpr void DestroyStore(store_t* store)
 		{
 			onDestroyCbs.call(*store, context); // this seems wrong
-			stores.erase(std::find_if(std::begin(stores), std::end(stores), [&](const auto& s)
+			if (flux_change_batch* batch = flux_change_batch::current())
+			{
+				// erasing shifts the stores after this one, so pending changes can't wait
+				batch->flush();
+			}
+			const auto erased = std::find_if(std::begin(stores), std::end(stores), [&](const auto& s)
 			{
 				return store == &s;
-			}));
+			});
+			const size_t position = static_cast<size_t>(erased - std::begin(stores));
+			if constexpr (is_keyed)
+			{
+				keyIndex.erase(erased->routingKey());
+			}
+			stores.erase(erased);
+
+			if constexpr (is_keyed)
+			{
+				// everything after the erased store shifted down by one
+				for (auto& [key, index] : keyIndex)
+				{
+					if (index > position)
+					{
+						index--;
+					}
+				}
+			}
 		}
 
 		template <typename signal_t>
 		constexpr int dispatch(const signal_t& signal)
+		{
+			return dispatchRange(signal, 0, stores.size());
+		}
+
+		// Same as dispatch, but only delivers to the store instances in [begin, end)
+		template <typename signal_t>
+		constexpr int dispatchRange(const signal_t& signal, size_t begin, size_t end)
 		{
 			int nHandled = 0;
 			cxpr::visit_tuple([&](const auto& cb)
 			{
 				using payload_t = typename std::decay_t<decltype(cb)>::payload_t;
 				if constexpr (std::is_same_v<payload_t, signal_t>)
+				{
+					nHandled += deliver(cb, signal, begin, end);
+				}
+
+			}, callbacks);
+
+			return nHandled;
+		}
+
+		// Same as dispatch, but for a whole run of signals of the same type. Each store handles
+		// the entire run before moving on to the next one, keeping its state hot in cache
+		template <typename payload_t>
+		constexpr int dispatchRun(const flux_signal_run<payload_t>& run)
+		{
+			int nHandled = 0;
+			cxpr::visit_tuple([&](const auto& cb)
+			{
+				using cb_payload_t = typename std::decay_t<decltype(cb)>::payload_t;
+				if constexpr (std::is_same_v<cb_payload_t, payload_t> && is_routed_v<payload_t>)
+				{
+					for (const auto& signal : run)
+					{
+						nHandled += deliver(cb, signal, 0, stores.size());
+					}
+				}
+				else if constexpr (std::is_same_v<cb_payload_t, payload_t>)
 				{
 					for (auto& s : stores)
 					{
-						cb.notify(s, context, signal);
-						nHandled++;
+						for (const auto& signal : run)
+						{
+							cb.notify(s, context, signal);
+							nHandled++;
+						}
 					}
 				}
 
@@ -95,8 +278,43 @@ namespace cxpr_flux
 		allocator_t allocator;
 		// deque so we don't invalidate on insert/delete
 		std::deque<store_t, rebind_alloc_t<store_t>> stores;
-		callback_list<void(store_t&, context_t& ctx)> onCreateCbs;
-		callback_list<void(store_t&, context_t& ctx)> onDestroyCbs;
+		key_index_t keyIndex;	// routing key -> position in stores, only used when is_keyed
+		callback_list_base<small_callback_size, void(store_t&, context_t& ctx), allocator_t> onCreateCbs;
+		callback_list_base<small_callback_size, void(store_t&, context_t& ctx), allocator_t> onDestroyCbs;
+
+	private:
+		template <typename signal_t>
+		static constexpr bool is_routed_v = is_keyed && has_routing_key_v<signal_t>;
+
+		// Delivers signal to the instances in [begin, end) through cb, either all of them or 
+		// just the key owner for routed signals
+		template <typename callback_t, typename signal_t>
+		constexpr int deliver(const callback_t& cb, const signal_t& signal, size_t begin, size_t end)
+		{
+			if constexpr (is_routed_v<signal_t>)
+			{
+				static_assert(std::is_convertible_v<routing_key_t<signal_t>, key_t>, "signal and store routing keys don't match");
+				const auto found = keyIndex.find(signal.routingKey());
+				if (found == keyIndex.end() || found->second < begin || found->second >= end)
+				{
+					return 0;
+				}
+
+				cb.notify(stores[found->second], context, signal);
+				return 1;
+			}
+			else
+			{
+				int nHandled = 0;
+				const auto last = std::next(std::begin(stores), end);
+				for (auto it = std::next(std::begin(stores), begin); it != last; ++it)
+				{
+					cb.notify(*it, context, signal);
+					nHandled++;
+				}
+				return nHandled;
+			}
+		}
 	};
 
 	//////////////////////////////////////////////////////////////////////////
@@ -156,6 +374,18 @@ namespace cxpr_flux
 			return ndispatched;
 		}
 
+		template <typename payload_t>
+		constexpr int dispatchRun(const flux_signal_run<payload_t>& run)
+		{
+			int ndispatched = 0;
+			cxpr::visit_tuple([&](auto& store) constexpr
+			{
+				ndispatched += store.dispatchRun(run);
+			}, stores);
+
+			return ndispatched;
+		}
+
 		stores_tuple_t stores;
 	};
 
@@ -166,41 +396,102 @@ namespace cxpr_flux
 		template <typename store_facade_t, typename ... messages_t>
 		constexpr decltype(auto) dispatch_table_impl(cxpr::typeset<messages_t...> token)
 		{
-			// Generate a static lookup map of all signals we care about
+			// Generate a flat table indexed by the dense signal index (see flux_signal_index), 
+			// so finding the handler for a signal is a single indexed load. The extra trailing
+			// entry catches signals no store handles (flux_signal_index::invalid_index)
 			using functor_t = int(*)(store_facade_t & ctx, const flux_signal & var);
-			return cxpr::make_static_map<cxpr::hash_t, functor_t>(
+			return std::array<functor_t, sizeof...(messages_t) + 1>
+			{
 				{
-					{	// pair start
-						// folding is fun. Generate a functor that takes in our untyped signal, up casts it,
-						// and the passes the typed signal to the store facade to dispatch correctly
-						cxpr::typehash_v<std::decay_t<messages_t>>,		   // first
-						
-						[](store_facade_t& ctx, const flux_signal& signal) // second
-						{
-							using payload_t = std::decay_t<messages_t>;
-							const auto& typed = *static_cast<const payload_t*>(signal.payload());
-							return ctx.dispatchSignal(typed);
-						}
+					// folding is fun. Generate a functor that takes in our untyped signal, up casts it,
+					// and the passes the typed signal to the store facade to dispatch correctly
+					[](store_facade_t& ctx, const flux_signal& signal)
+					{
+						using payload_t = std::decay_t<messages_t>;
+						const auto& typed = *static_cast<const payload_t*>(signal.payload());
+						return ctx.dispatchSignal(typed);
+					}...,
+					
+					[](store_facade_t& ctx, const flux_signal& signal) { return 0; }
+				}
+			};
+		}
+
+		template <typename store_facade_t, typename ... messages_t>
+		constexpr decltype(auto) run_table_impl(cxpr::typeset<messages_t...> token)
+		{
+			// one entry per signal index, each dispatching a homogeneous run of that payload
+			using functor_t = int(*)(store_facade_t& ctx, const flux_signal_node* first);
+			return std::array<functor_t, sizeof...(messages_t)>
+			{
+				{
+					[](store_facade_t& ctx, const flux_signal_node* first)
+					{
+						using payload_t = std::decay_t<messages_t>;
+						return ctx.dispatchRun(flux_signal_run<payload_t>{ first });
 					}...
-				});
+				}
+			};
+		}
+
+		template <typename facade_t, typename ... messages_t>
+		constexpr decltype(auto) shard_table_impl(cxpr::typeset<messages_t...> token)
+		{
+			// per-facade version of the dispatch table, restricted to a range of store instances
+			using functor_t = int(*)(facade_t& facade, const flux_signal& signal, size_t begin, size_t end);
+			return std::array<functor_t, sizeof...(messages_t) + 1>
+			{
+				{
+					[](facade_t& facade, const flux_signal& signal, size_t begin, size_t end)
+					{
+						using payload_t = std::decay_t<messages_t>;
+						return facade.dispatchRange(*static_cast<const payload_t*>(signal.payload()), begin, end);
+					}...,
+
+					[](facade_t& facade, const flux_signal& signal, size_t begin, size_t end) { return 0; }
+				}
+			};
 		}
 
+		// only used to infer types, never called
+		template <typename ... messages_t>
+		flux_signal_index<std::decay_t<messages_t>...> make_signal_index(cxpr::typeset<messages_t...> token);
+
 		template <typename T>
 		using fetch_payload_t = typename T::payload_t;
 
+		// get a list of all callbacks for all the stores, collapse to a single tuple and then 
+		// reduce the callbacks to just their payload type
+		template <typename ... stores_t>
+		using payloads_t = cxpr::mutate_types_t<
+			cxpr::tuple_unique_t<cxpr::collapse_tuples_t<decltype(stores_t::GetCallbacks())...>>, fetch_payload_t>;
+
+		template <typename ... stores_t>
+		using signal_index_t = decltype(make_signal_index(payloads_t<stores_t...>{}));
+
 		//////////////////////////////////////////////////////////////////////////
 
 		template <typename store_facade_t, typename ... stores_t>
 		constexpr decltype(auto) generate_dispatch_table()
 		{
-			// get a list of all callbacks for all the stores, and collapse to a single tuple
-			using callbacks_t = cxpr::tuple_unique_t<cxpr::collapse_tuples_t<decltype(stores_t::GetCallbacks())...>>;
-			// reduce the callbacks to just their payload type
-			using payloads_t = cxpr::mutate_types_t<callbacks_t, fetch_payload_t>;
 			// generate a token to infer types in the next call
-			constexpr payloads_t token = {};
+			constexpr payloads_t<stores_t...> token = {};
 			return dispatch_table_impl<store_facade_t>(token);
 		}
+
+		template <typename store_facade_t, typename ... stores_t>
+		constexpr decltype(auto) generate_run_table()
+		{
+			constexpr payloads_t<stores_t...> token = {};
+			return run_table_impl<store_facade_t>(token);
+		}
+
+		template <typename facade_t, typename ... stores_t>
+		constexpr decltype(auto) generate_shard_table()
+		{
+			constexpr payloads_t<stores_t...> token = {};
+			return shard_table_impl<facade_t>(token);
+		}
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -211,7 +502,8 @@ namespace cxpr_flux
 	public:
 		using allocator_t = _allocator_t;
 		using my_t = flux_static_context<allocator_t, stores_t...>;
-		using dispatcher_t = flux_dispatcher<allocator_t>;
+		using signal_index_t = __detail::signal_index_t<stores_t...>;
+		using dispatcher_t = flux_dispatcher<allocator_t, signal_index_t>;
 		using store_facade_t = static_store_collection<my_t, stores_t...>;
 
 		using allocator_wrapper_t = stl_allocator_helper<allocator_t>;
@@ -223,35 +515,181 @@ namespace cxpr_flux
 		constexpr flux_static_context() noexcept(std::is_nothrow_default_constructible_v<allocator_t>)
 			: flux_static_context(allocator_t{}) {}
 
-		constexpr flux_static_context(const allocator_t& _alloc)
-			: allocator(_alloc), dispatcher(nullptr), stores(nullptr)
+		// built straight in the init list, a null uniq_ptr would need a default constructible allocator
+		constexpr flux_static_context(const allocator_t& _alloc, const flux_dispatcher_options& options = {})
+			:	allocator(_alloc),
+				dispatcher(allocator_wrapper_t::template _allocate_one_uniq<dispatcher_t>(allocator, allocator, options)),
+				stores(allocator_wrapper_t::template _allocate_one_uniq<store_facade_t>(allocator, *this, allocator)),
+				shards(allocator),
+				shardChanges(allocator)
 		{
-			dispatcher = allocator_wrapper_t::template _allocate_one_uniq<dispatcher_t>(allocator, allocator);
-			stores = allocator_wrapper_t::template _allocate_one_uniq<store_facade_t>(allocator, *this, allocator);
 		}
 
 		virtual dispatcher_t& getDispatcher() noexcept{ return *dispatcher; }
 		constexpr store_facade_t& getStores() noexcept { return *stores; }
 
+		//////////////////////////////////////////////////////////////////////////
+		// processSignals
+		// Drains the dispatcher and delivers every signal to the stores in enqueue order. Stores
+		// calling emitChanged during the pass are notified once each after the drain, in the 
+		// order they first changed.
 		decltype(auto) processSignals()
+		{
+			const auto result = processSignals(flux_dispatch_budget{});
+			return std::make_pair(result.nDispatched, result.nHandled);
+		}
+
+		// Budgeted processSignals, stops after budget.maxSignals or once budget.deadline has
+		// passed and leaves the rest queued for the next call (see flux_dispatch_budget). 
+		// Lets a frame-paced consumer spread a burst over several frames.
+		flux_dispatch_result processSignals(const flux_dispatch_budget& budget)
 		{
 			constexpr auto dispatchTable = __detail::generate_dispatch_table<store_facade_t, stores_t...>();
-			return dispatcher->processSignals([&](const auto& signal)
+			auto active = changes.activate();
+			auto result = dispatcher->processSignals([&](const auto& signal)
 			{
+				// every index (including invalid_index) has an entry, no need to validate
+				return dispatchTable[signal.index()](*stores, signal);
+			}, budget);
+			changes.flush();
+			return result;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// processSignalsGrouped
+		// Alternative to processSignals that buckets the drained signals by their inline type
+		// index, then hands each store one homogeneous run at a time instead of visiting every 
+		// store once per signal. Signals of the same type keep their enqueue order, but types
+		// are processed one after the other (in signal index order), so only use this when
+		// stores don't depend on the relative order of different signal types.
+		decltype(auto) processSignalsGrouped()
+		{
+			constexpr auto runTable = __detail::generate_run_table<store_facade_t, stores_t...>();
+			auto active = changes.activate();
+			auto result = dispatcher->processSignalList([&](flux_signal_node* signal)
+			{
+				// the last bucket collects signals no store handles
+				constexpr std::uint32_t nBuckets = signal_index_t::size + 1;
+				flux_signal_node* heads[nBuckets] = {};
+				flux_signal_node* tails[nBuckets] = {};
+				int nDispatched = 0;
+				// relink through next as we go, we own the list so no allocation is needed
+				while (signal != nullptr)
+				{
+					flux_signal_node* next = signal->next.load(std::memory_order_acquire);
+					const std::uint32_t index = signal->index();
+					if (heads[index] == nullptr)
+					{
+						heads[index] = signal;
+					}
+					else
+					{
+						tails[index]->next.store(signal, std::memory_order_relaxed);
+					}
+					tails[index] = signal;
+					signal = next;
+					nDispatched++;
+				}
+
 				int nHandled = 0;
-				// find the entry in the map, validate it, and call
-				auto [found, entry] = dispatchTable.get_entry(signal.hash());
-				if (found)
+				for (std::uint32_t index = 0; index < signal_index_t::size; index++)
 				{
-					nHandled = std::invoke(*entry, *stores, signal);
+					if (heads[index] != nullptr)
+					{
+						tails[index]->next.store(nullptr, std::memory_order_relaxed);
+						nHandled += runTable[index](*stores, heads[index]);
+					}
 				}
-				return nHandled;
+
+				return std::make_pair(nDispatched, nHandled);
+			});
+			changes.flush();
+			return result;
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// processSignalsParallel
+		// Alternative to processSignals that spreads store dispatch over a thread pool. The 
+		// instances of every store type are split into shards of up to storesPerShard, and each 
+		// shard walks the whole drained list on its own task, so every store still sees every 
+		// signal in enqueue order. Stores handlers run concurrently, so they must not touch state
+		// owned by another store, and must not create/destroy stores while dispatching. Change
+		// notifications are collected per shard and flushed on the calling thread once every
+		// shard is done, so listeners never run concurrently.
+		decltype(auto) processSignalsParallel(flux_thread_pool& pool, size_t storesPerShard = 64)
+		{
+			return dispatcher->processSignalList([&](const flux_signal_node* signals)
+			{
+				int nDispatched = 0;
+				for (auto signal = signals; signal != nullptr; signal = signal->next.load(std::memory_order_acquire))
+				{
+					nDispatched++;
+				}
+
+				shards.clear();
+				cxpr::visit_tuple([&](auto& facade)
+				{
+					using facade_t = std::decay_t<decltype(facade)>;
+					const size_t nStores = facade.stores.size();
+					for (size_t begin = 0; begin < nStores; begin += storesPerShard)
+					{
+						shards.push_back({ &dispatch_shard<facade_t>, &facade, begin, std::min(nStores, begin + storesPerShard), 0 });
+					}
+				}, stores->stores);
+
+				if (shardChanges.size() < shards.size())
+				{
+					shardChanges.resize(shards.size());
+				}
+
+				pool.parallel_for(shards.size(), [&](size_t index)
+				{
+					auto& shard = shards[index];
+					auto active = shardChanges[index].activate();
+					shard.nHandled = shard.dispatch(shard.facade, signals, shard.begin, shard.end);
+				});
+
+				int nHandled = 0;
+				for (size_t index = 0; index < shards.size(); index++)
+				{
+					nHandled += shards[index].nHandled;
+					shardChanges[index].flush();
+				}
+
+				return std::make_pair(nDispatched, nHandled);
 			});
 		}
 
 	private:
+		struct dispatch_shard_t
+		{
+			int(*dispatch)(void* facade, const flux_signal_node* signals, size_t begin, size_t end);
+			void* facade;
+			size_t begin;
+			size_t end;
+			int nHandled;
+		};
+
+		template <typename facade_t>
+		static int dispatch_shard(void* facade, const flux_signal_node* signals, size_t begin, size_t end)
+		{
+			constexpr auto shardTable = __detail::generate_shard_table<facade_t, stores_t...>();
+			int nHandled = 0;
+			for (auto signal = signals; signal != nullptr; signal = signal->next.load(std::memory_order_relaxed))
+			{
+				nHandled += shardTable[signal->index()](*static_cast<facade_t*>(facade), *signal, begin, end);
+			}
+			return nHandled;
+		}
+
+
 		allocator_t allocator; // must be declared first
 		uniq_ptr<dispatcher_t> dispatcher;
 		uniq_ptr<store_facade_t> stores;
+		// scratch list for processSignalsParallel, kept around so steady-state frames don't allocate
+		std::vector<dispatch_shard_t, typename allocator_wrapper_t::template rebind_alloc_t<dispatch_shard_t>> shards;
+		// stores that changed during the current pass, one batch per shard for processSignalsParallel
+		flux_change_batch changes;
+		std::vector<flux_change_batch, typename allocator_wrapper_t::template rebind_alloc_t<flux_change_batch>> shardChanges;
 	};
 }
\ No newline at end of file
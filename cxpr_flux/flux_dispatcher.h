@@ -1,53 +1,221 @@
 #pragma once
 
+#include <chrono>
+#include <thread>
+
 //////////////////////////////////////////////////////////////////////////
 
 namespace cxpr_flux
 {
-	template <typename allocator_t>
+	//////////////////////////////////////////////////////////////////////////
+	// flux_purge_mode
+	// When a drained buffer's arena gets purged (its signals destroyed, its slabs reset)
+	enum class flux_purge_mode
+	{
+		immediate,	// right after the dispatch, inside processSignals
+		deferred,	// once the ring comes back around to the buffer, just before it's reused
+		background,	// on flux_dispatcher_options::purgePool, reuse waits for it if it isn't done
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_dispatcher_options
+	// Runtime configuration for a flux_dispatcher, fixed at construction
+	struct flux_dispatcher_options
+	{
+		// Give every producing thread its own ring of signal arenas instead of sharing a 
+		// single ring between all producers. Allocation never contends across threads, at the
+		// cost of a ring per producer. Signals from one thread keep their order, signals
+		// from different threads are delivered grouped by thread.
+		bool perThreadArenas = false;
+
+		// Buffers (arena + queue) in the ring, at least 2. Producers fill one while the previous
+		// one is dispatched, any more give deferred/background purges room to finish before the
+		// buffer is needed again.
+		size_t nBuffers = 2;
+
+		// Drained buffers holding a backlog (see laneBudgets, flux_dispatch_budget) can't be 
+		// reused, so while every buffer in the ring is held spares are added, up to maxBuffers, 
+		// and producers always have a free one to move on to. Spares are kept for later bursts.
+		// Only once all maxBuffers are held is the oldest backlog delivered regardless of the
+		// budgets.
+		size_t maxBuffers = 64;
+
+		flux_purge_mode purgeMode = flux_purge_mode::immediate;
+		flux_thread_pool* purgePool = nullptr;	// required for flux_purge_mode::background, must outlive the dispatcher
+
+		// Most signals each priority lane (see flux_priority) delivers per processSignals call,
+		// the rest stay queued in order for the next call (see maxBuffers).
+		size_t laneBudgets[flux_priority_count] = { flux_unlimited_budget, flux_unlimited_budget, flux_unlimited_budget };
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_dispatch_budget
+	// Limits a single processSignals call. Whatever doesn't fit stays queued in order (it 
+	// isn't copied, its buffer is just held on to) and goes out first on the next call, within
+	// the limits in flux_dispatcher_options::laneBudgets. The deadline is checked every 
+	// deadlineInterval signals, so a call overshoots it by at most that many signals.
+	// Every call still takes in the signals raised since the last one, so a high priority 
+	// signal never waits behind a lower lane's backlog (see flux_dispatcher_options::maxBuffers).
+	struct flux_dispatch_budget
+	{
+		size_t maxSignals = flux_unlimited_budget;
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		size_t deadlineInterval = 256;
+	};
+
+	struct flux_dispatch_result
+	{
+		int nDispatched = 0;
+		int nHandled = 0;
+		size_t nRemaining = 0;	// held over for the next call, not counting signals raised since this one started
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_dispatcher
+	// Multi-buffered signal queue. Producers construct signals into the current arena and
+	// append them to that arena's lock-free queue, while processSignals moves them on to the 
+	// next buffer in the ring and drains the old one. Drained buffers are purged right away,
+	// or later/on a pool (see flux_purge_mode), so enqueueing, dispatching and reclaiming can
+	// run as separate stages. Any number of threads may call signal(), only one thread may 
+	// call processSignals at a time. signal_index_t assigns the dense type index stored in 
+	// every signal (see flux_signal_index), contexts pass their payload set. arena_slab_size
+	// is the size of the first slab of every arena, later slabs grow as needed.
+	// Every buffer has a queue per priority lane, so a flood of low priority signals doesn't 
+	// hold up the high priority ones: processSignals delivers the lanes highest first, each up
+	// to its budget. A drained buffer is only purged once all of its lanes are delivered.
+	template <typename allocator_t, typename _signal_index_t = flux_signal_index<>, size_t arena_slab_size = 1024 * 32>
 	class flux_dispatcher
 	{
 	public:
-		using my_t = flux_dispatcher<allocator_t>;
+		using my_t = flux_dispatcher<allocator_t, _signal_index_t, arena_slab_size>;
+		using signal_index_t = _signal_index_t;
 		using signal_t = flux_signal_node;
 		template <typename T>
 		using signal_impl_t = flux_signal_impl<my_t,T>;
 		using allocator_wrapper_t = stl_allocator_helper<allocator_t>;
-		using arena_t = cxpr_flux::arena_allocator<allocator_t, 1024 * 32>;
+		using arena_t = cxpr_flux::arena_allocator<allocator_t, arena_slab_size>;
+		using resource_t = arena_resource<arena_t>;
 
 		template <typename T>
 		using uniq_ptr = typename allocator_wrapper_t::template uniq_ptr<T>;
+		template <typename T>
+		using rebind_alloc_t = typename allocator_wrapper_t::template rebind_alloc_t<T>;
 
-		constexpr flux_dispatcher(const allocator_t& _alloc)
+		flux_dispatcher(const allocator_t& _alloc, const flux_dispatcher_options& _options = {})
 			:	allocator(_alloc),
-				arenaA(allocator_wrapper_t::template _allocate_one_uniq<arena_t>(allocator)),
-				arenaB(allocator_wrapper_t::template _allocate_one_uniq<arena_t>(allocator)),
-				currentAllocator(arenaA.get()),
-				head(nullptr),
-				tail(nullptr)
+				options(_options),
+				dispatcherId(next_dispatcher_id()),
+				currentBuffer(0),
+				slots(nullptr),
+				frames(_options.maxBuffers, allocator),
+				nFrames(static_cast<int>(_options.nBuffers))
 		{
+			precondition_check(options.nBuffers >= 2);
+			precondition_check(options.maxBuffers >= options.nBuffers);
+			precondition_check(options.purgeMode != flux_purge_mode::background || options.purgePool != nullptr);
+			if (!options.perThreadArenas)
+			{
+				// single slot shared by every producer
+				slots.store(allocator_wrapper_t::template _allocate_one<producer_slot>(allocator, allocator, options));
+			}
+		}
+
+		~flux_dispatcher()
+		{
+			// background purges still hold on to the slots
+			for (size_t index = 0; index < frames.size(); index++)
+			{
+				reclaim_frame(index);
+			}
+
+			producer_slot* slot = slots.load();
+			while (slot != nullptr)
+			{
+				producer_slot* next = slot->nextSlot;
+				allocator_wrapper_t::template _deallocate_one<producer_slot>(allocator, slot);
+				slot = next;
+			}
 		}
 
 		template <typename payload_t>
 		void signal(payload_t&& payload)
 		{
+			emplace<std::decay_t<payload_t>>(std::forward<payload_t>(payload));
+		}
+
+		// Queues payload in the lane for priority instead of its type's default lane
+		template <typename payload_t>
+		void signal(flux_priority priority, payload_t&& payload)
+		{
+			emplace_in_lane<std::decay_t<payload_t>>(priority, std::forward<payload_t>(payload));
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// emplace
+		// Constructs a payload_t signal in place from params. Payloads using 
+		// flux_payload_allocator get it pointed at the signal arena (see make_using_allocator),
+		// so e.g. a flux_string member built straight from a const char* never touches the heap.
+		template <typename payload_t, typename ... params_t>
+		void emplace(param_pack_t params)
+		{
+			emplace_in_lane<payload_t>(flux_signal_priority_v<payload_t>, perfect_forward(params));
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// signal_batch
+		// Enqueues count signals of payload_t, the i'th constructed from generator(i). Payloads
+		// are built back to back in as few arena allocations as possible and each run is published
+		// with a single splice, so synchronization is paid per run instead of per signal. The
+		// whole batch always lands in the same processSignals pass.
+		template <typename payload_t, typename generator_t>
+		void signal_batch(size_t count, generator_t&& generator)
+		{
+			using impl_t = signal_impl_t<std::decay_t<payload_t>>;
+			constexpr size_t runSize = arena_t::template max_construct_n<impl_t>();
+			constexpr size_t lane = static_cast<size_t>(flux_signal_priority_v<payload_t>);
 			try
 			{
-				auto ll = lock.scoped_lock();
-				auto created = currentAllocator->construct<signal_impl_t<std::decay_t<payload_t>>>
-					("Signal", std::forward<payload_t>(payload));
-
-				if (head == nullptr)
+				auto writer = acquire_writer();
+				if constexpr (runSize == 0)
 				{
-					head = created;
-					tail = head;
+					// bigger than a slab, every payload gets an allocation of its own (see
+					// arena_allocator::alloc) but the batch still goes out in one splice
+					signal_t* first = nullptr;
+					signal_t* last = nullptr;
+					for (size_t i = 0; i < count; i++)
+					{
+						signal_t* created = writer.buffer->arena.template construct<impl_t>("Signal", generator(i));
+						if (last != nullptr)
+						{
+							last->next.store(created, std::memory_order_relaxed);
+						}
+						else
+						{
+							first = created;
+						}
+						last = created;
+					}
+
+					if (first != nullptr)
+					{
+						writer.buffer->queues[lane].push_range(first, last);
+					}
 				}
 				else
 				{
-					tail->next = created;
-					tail = created;
-				}
+					for (size_t offset = 0; offset < count; offset += runSize)
+					{
+						const size_t nRun = std::min(runSize, count - offset);
+						auto created = writer.buffer->arena.template construct_n<impl_t>("Signal", nRun,
+							[&](size_t index) -> decltype(auto) { return generator(offset + index); });
 
+						for (size_t i = 1; i < nRun; i++)
+						{
+							created[i - 1].next.store(&created[i], std::memory_order_relaxed);
+						}
+						writer.buffer->queues[lane].push_range(&created[0], &created[nRun - 1]);
+					}
+				}
 			}
 			catch (std::bad_alloc)
 			{
@@ -55,67 +223,708 @@ namespace cxpr_flux
 			}
 		}
 
+		//////////////////////////////////////////////////////////////////////////
+		// signal_range
+		// Enqueues a copy of every payload in [first, last), see signal_batch. Wrap the iterators
+		// in std::make_move_iterator to move the payloads instead.
+		template <typename iter_t>
+		void signal_range(iter_t first, iter_t last)
+		{
+			using payload_t = std::decay_t<decltype(*first)>;
+			const size_t count = static_cast<size_t>(std::distance(first, last));
+			// runs are constructed in order, so the generator can just walk the iterator
+			signal_batch<payload_t>(count, [&](size_t) -> decltype(auto) { return *first++; });
+		}
+
 		template <typename func_t>
 		std::pair<int, int> processSignals(func_t&& functor)
 		{
-			auto dispatcherState = swap_state();
-			int nDispatched = 0;
+			const auto result = processSignals(std::forward<func_t>(functor), flux_dispatch_budget{});
+			return std::make_pair(result.nDispatched, result.nHandled);
+		}
+
+		template <typename func_t>
+		flux_dispatch_result processSignals(func_t&& functor, const flux_dispatch_budget& budget)
+		{
+			return processSignalList([&](signal_t* currentSignal)
+			{
+				int nDispatched = 0;
+				int nHandled = 0;
+				while (currentSignal != nullptr)
+				{
+					nHandled += functor(*currentSignal);
+					currentSignal = currentSignal->next.load(std::memory_order_acquire);
+					nDispatched++;
+				}
+
+				return std::make_pair(nDispatched, nHandled);
+			}, budget);
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// processSignalList
+		// Hands the drained list to functor, which returns the (dispatched, handled) counts.
+		// The list holds the lanes highest priority first, each in enqueue order and cut off at
+		// its budget. It's owned by the caller until functor returns, so it's free to relink the 
+		// signals through next, e.g. to bucket them. Producers are never blocked by the drain, 
+		// they've already moved on to the next buffer. functor is called a second time, ahead
+		// of the usual call, when all maxBuffers hold backlog and the oldest has to be delivered
+		// so its buffer can be reused.
+		template <typename func_t>
+		std::pair<int, int> processSignalList(func_t&& functor)
+		{
+			const auto result = processSignalList(std::forward<func_t>(functor), flux_dispatch_budget{});
+			return std::make_pair(result.nDispatched, result.nHandled);
+		}
+
+		// Budgeted version of the above. With a deadline the signals are handed over in runs of
+		// up to budget.deadlineInterval, one functor call each, until the deadline passes.
+		template <typename func_t>
+		flux_dispatch_result processSignalList(func_t&& functor, const flux_dispatch_budget& budget)
+		{
+			flux_dispatch_result result = {};
+			auto accumulate = [&](const std::pair<int, int>& dispatched)
+			{
+				result.nDispatched += dispatched.first;
+				result.nHandled += dispatched.second;
+			};
+
+			const bool hasDeadline = (budget.deadline != std::chrono::steady_clock::time_point::max());
+			const size_t runSize = hasDeadline ? std::max<size_t>(budget.deadlineInterval, 1) : flux_unlimited_budget;
 
-			auto ll = lock.scoped_lock();
-			int nHandled = 0;
-			auto currentSignal = dispatcherState.head;
-			while (currentSignal != nullptr)
+			int nextIndex = next_free_frame(currentBuffer.load(std::memory_order_relaxed));
+			if (nextIndex < 0)
 			{
-				nHandled += functor(*currentSignal);
-				currentSignal = currentSignal->next;
-				nDispatched++;
+				// every buffer holds backlog, flush the oldest so it can be reused
+				nextIndex = oldest_held_frame();
+				size_t noBudget[flux_priority_count] = {};
+				accumulate(dispatch_lanes(functor, noBudget, 0, nextIndex).result);
+			}
+
+			// only lanes that may be cut need their length, the rest is delivered whole
+			bool countLanes[flux_priority_count];
+			for (size_t laneIndex = 0; laneIndex < flux_priority_count; laneIndex++)
+			{
+				countLanes[laneIndex] = std::min(std::min(options.laneBudgets[laneIndex], budget.maxSignals), runSize) != flux_unlimited_budget;
+			}
+
+			// the swapped out buffers are private to us from here on, producers have moved on
+			// to the next ones so nothing below blocks them
+			append_frame(swap_state(nextIndex), countLanes);
+
+			size_t laneBudgets[flux_priority_count];
+			std::copy(std::begin(options.laneBudgets), std::end(options.laneBudgets), laneBudgets);
+			size_t nLeft = budget.maxSignals;
+			while (true)
+			{
+				const size_t nRun = std::min(nLeft, runSize);
+				const auto dispatched = dispatch_lanes(functor, laneBudgets, nRun, -1);
+				accumulate(dispatched.result);
+				if (nLeft != flux_unlimited_budget)
+				{
+					nLeft -= dispatched.nTaken;
+				}
+
+				if (!hasDeadline || dispatched.nTaken == 0 || nLeft == 0 || std::chrono::steady_clock::now() >= budget.deadline)
+				{
+					break;
+				}
 			}
 
-			dispatcherState.allocator->purge();
+			result.nRemaining = backlog();
+			return result;
+		}
 
-			return std::make_pair(nDispatched, nHandled);
+		// Signals drained by an earlier processSignals call that didn't fit its budget
+		size_t backlog() const noexcept
+		{
+			size_t nSignals = 0;
+			for (const auto& lane : lanes)
+			{
+				nSignals += lane.count;
+			}
+			return nSignals;
 		}
 
 	private:
-		struct dispatcher_context
+		static constexpr int max_writer_spins = 64;
+
+		template <typename payload_t, typename ... params_t>
+		void emplace_in_lane(flux_priority priority, param_pack_t params)
+		{
+			try
+			{
+				auto writer = acquire_writer();
+				auto created = writer.buffer->arena.template construct<signal_impl_t<payload_t>>
+					("Signal", std::allocator_arg, flux_payload_allocator(&writer.buffer->resource), perfect_forward(params));
+
+				writer.buffer->queues[static_cast<size_t>(priority)].push(created);
+			}
+			catch (std::bad_alloc)
+			{
+
+			}
+		}
+
+		struct signal_buffer
+		{
+			signal_buffer(allocator_t& allocator) : arena(allocator), resource(arena) {}
+
+			flux_signal_queue queues[flux_priority_count];
+			std::atomic<int> writers = 0;	// producers currently constructing into this buffer
+			arena_t arena;
+			resource_t resource;			// pmr view of arena for payload members
+		};
+
+		//////////////////////////////////////////////////////////////////////////
+		// Ring of arena + queue buffers. Either one shared by all producers or one per
+		// producing thread, depending on flux_dispatcher_options::perThreadArenas
+		struct producer_slot
+		{
+			producer_slot(allocator_t& _allocator, const flux_dispatcher_options& options)
+				:	allocator(_allocator),
+					buffers(options.maxBuffers, _allocator)
+			{
+				// spares past nBuffers are created by the first producer to need them
+				for (size_t i = 0; i < options.nBuffers; i++)
+				{
+					buffers[i].store(allocator_wrapper_t::template _allocate_one<signal_buffer>(allocator, allocator), std::memory_order_relaxed);
+				}
+			}
+
+			~producer_slot()
+			{
+				for (auto& buffer : buffers)
+				{
+					if (buffer.load(std::memory_order_relaxed) != nullptr)
+					{
+						allocator_wrapper_t::template _deallocate_one<signal_buffer>(allocator, buffer.load(std::memory_order_relaxed));
+					}
+				}
+			}
+
+			allocator_t allocator;
+			// one per frame, buffers are pinned by producers so they never move
+			std::vector<std::atomic<signal_buffer*>, rebind_alloc_t<std::atomic<signal_buffer*>>> buffers;
+			std::thread::id owner;
+			producer_slot* nextSlot = nullptr;	// slots are only ever prepended, never removed
+		};
+
+		//////////////////////////////////////////////////////////////////////////
+		// Reclaim state of the index'th buffer of every slot, only the consumer marks a frame
+		// dirty. Background purges clear purging from the pool.
+		enum class frame_state : int
+		{
+			clean,
+			dirty,		// drained, waiting for a deferred purge
+			purging		// drained, purge submitted to the pool
+		};
+
+		struct buffer_frame
+		{
+			std::atomic<frame_state> state = frame_state::clean;
+
+			// consumer only, from the swap until the frame is retired
+			producer_slot* slots = nullptr;							// slots that existed at swap time
+			std::uint64_t sequence = 0;								// swap it was drained by
+			signal_t* laneTails[flux_priority_count] = {};			// last signal per lane still waiting in a backlog
+			int laneNext[flux_priority_count] = {};					// next newer frame in each lane's backlog
+			int nHeldLanes = 0;										// lanes with a laneTail
+			bool retiring = false;									// fully delivered, retire after the functor
+		};
+
+		//////////////////////////////////////////////////////////////////////////
+		// Signals drained from the buffers but not delivered yet, possibly spanning a few frames.
+		// Consumer only.
+		struct signal_lane
 		{
 			signal_t* head = nullptr;
 			signal_t* tail = nullptr;
-			arena_t* allocator = nullptr;
+			size_t count = 0;		// only kept for lanes that can be cut, see append_frame
+			int frontFrame = -1;	// oldest frame with signals in the lane
+			int backFrame = -1;
+		};
+
+		struct signal_span
+		{
+			signal_t* first = nullptr;
+			signal_t* last = nullptr;
+			size_t count = 0;
+		};
+
+		struct dispatched_run
+		{
+			std::pair<int, int> result;
+			size_t nTaken;
+		};
+
+		//////////////////////////////////////////////////////////////////////////
+		// Pins the current buffer for the duration of a single signal() call so the consumer
+		// can't drain/purge it out from under us
+		struct scoped_writer
+		{
+			scoped_writer(signal_buffer* _buffer) : buffer(_buffer) {}
+			scoped_writer(scoped_writer&& other) noexcept : buffer(other.buffer) { other.buffer = nullptr; }
+			~scoped_writer()
+			{
+				if (buffer != nullptr)
+				{
+					buffer->writers.fetch_sub(1, std::memory_order_release);
+				}
+			}
+
+			signal_buffer* buffer;
+		};
+
+		[[nodiscard]] scoped_writer acquire_writer()
+		{
+			producer_slot& slot = local_slot();
+			while (true)
+			{
+				// register first, then make sure the buffer is still current. Pairs with the
+				// store -> load sequence in swap_state (both seq_cst), so either we see the swap
+				// and retry or the consumer sees us and waits
+				const int index = currentBuffer.load(std::memory_order_seq_cst);
+				signal_buffer* buffer = slot.buffers[index].load(std::memory_order_seq_cst);
+				if (buffer == nullptr)
+				{
+					buffer = create_buffer(slot, index);
+				}
+				buffer->writers.fetch_add(1, std::memory_order_seq_cst);
+				if (currentBuffer.load(std::memory_order_seq_cst) == index)
+				{
+					return scoped_writer(buffer);
+				}
+
+				buffer->writers.fetch_sub(1, std::memory_order_release);
+			}
+		}
+
+		// Installs a spare buffer, seq_cst so a consumer that saw us pin it also sees it
+		signal_buffer* create_buffer(producer_slot& slot, int index)
+		{
+			signal_buffer* created = allocator_wrapper_t::template _allocate_one<signal_buffer>(slot.allocator, slot.allocator);
+			signal_buffer* installed = nullptr;
+			if (slot.buffers[index].compare_exchange_strong(installed, created, std::memory_order_seq_cst))
+			{
+				return created;
+			}
+
+			allocator_wrapper_t::template _deallocate_one<signal_buffer>(slot.allocator, created);
+			return installed;
+		}
+
+		struct dispatcher_context
+		{
+			int index = 0;						// buffer being drained
+			producer_slot* slots = nullptr;		// slots that existed at swap time
 		};
 
-		[[nodiscard]] dispatcher_context swap_state()
+		[[nodiscard]] dispatcher_context swap_state(int nextIndex)
 		{
-			auto ll = lock.scoped_lock();
 			dispatcher_context contextOut = {};
-			contextOut.head = head;
-			contextOut.tail = tail;
-			contextOut.allocator = currentAllocator;
+			// only the consumer ever swaps, so a relaxed read of our own last store is fine
+			contextOut.index = currentBuffer.load(std::memory_order_relaxed);
 
-			// swap allocators
-			if (currentAllocator == arenaA.get())
+			// the next buffer isn't current, so producers can't write to it (a stale one that
+			// pins it sees the index hasn't moved there yet and retries). Finish reclaiming it
+			// before handing it out
+			reclaim_frame(nextIndex);
+			currentBuffer.store(nextIndex, std::memory_order_seq_cst);
+			// a slot registered after this load can only ever have seen the new buffer index
+			// (seq_cst pairs with the registration in find_or_create_slot)
+			contextOut.slots = slots.load(std::memory_order_seq_cst);
+
+			// wait out any producer that grabbed an old buffer before the swap, after this
+			// the old queues are fully linked and nobody else will touch them. A writer only
+			// pins the buffer for a single construct + push, so spin briefly before yielding
+			for_each_slot(contextOut.slots, [&](producer_slot& slot)
 			{
-				currentAllocator = arenaB.get();
+				const signal_buffer* buffer = slot.buffers[contextOut.index].load(std::memory_order_seq_cst);
+				if (buffer == nullptr)
+				{
+					return;
+				}
+
+				for (int spins = 0; buffer->writers.load(std::memory_order_seq_cst) != 0; spins++)
+				{
+					if (spins < max_writer_spins)
+					{
+						flux_cpu_relax();
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+
+			return contextOut;
+		}
+
+		// Next buffer for the producers: the first one after current that isn't held by a
+		// backlog, or a new spare. -1 if all maxBuffers are held.
+		int next_free_frame(int current)
+		{
+			for (int offset = 1; offset < nFrames; offset++)
+			{
+				const int index = (current + offset) % nFrames;
+				if (frames[index].nHeldLanes == 0)
+				{
+					return index;
+				}
 			}
-			else
+
+			return (nFrames < static_cast<int>(frames.size())) ? nFrames++ : -1;
+		}
+
+		int oldest_held_frame() const
+		{
+			int oldest = -1;
+			for (int index = 0; index < nFrames; index++)
 			{
-				currentAllocator = arenaA.get();
+				if (frames[index].nHeldLanes > 0 && (oldest < 0 || frames[index].sequence < frames[oldest].sequence))
+				{
+					oldest = index;
+				}
 			}
+			return oldest;
+		}
+
+		// Splices every slot's queue for the drained buffer onto the end of each lane. Lanes
+		// that may be cut this call are counted here, producers don't keep a count so their
+		// push stays a single exchange. A lane that isn't counted is delivered whole, so 
+		// whatever is left over in a lane has always been counted.
+		void append_frame(const dispatcher_context& context, const bool(&countLanes)[flux_priority_count])
+		{
+			buffer_frame& frame = frames[context.index];
+			frame.slots = context.slots;
+			frame.sequence = nSwaps++;
+			for (size_t laneIndex = 0; laneIndex < flux_priority_count; laneIndex++)
+			{
+				signal_lane& lane = lanes[laneIndex];
+				for_each_slot(context.slots, [&](producer_slot& slot)
+				{
+					const signal_buffer* buffer = slot.buffers[context.index].load(std::memory_order_relaxed);
+					if (buffer == nullptr || buffer->queues[laneIndex].front() == nullptr)
+					{
+						return;
+					}
+
+					const flux_signal_queue& queue = buffer->queues[laneIndex];
+					if (countLanes[laneIndex])
+					{
+						for (const signal_t* signal = queue.front(); ; signal = signal->next.load(std::memory_order_relaxed))
+						{
+							lane.count++;
+							if (signal == queue.back())
+							{
+								break;
+							}
+						}
+					}
 
-			head = nullptr;
-			tail = nullptr;
+					if (lane.head == nullptr)
+					{
+						lane.head = queue.front();
+					}
+					else
+					{
+						lane.tail->next.store(queue.front(), std::memory_order_relaxed);
+					}
+					lane.tail = queue.back();
+					frame.laneTails[laneIndex] = lane.tail;
+				});
 
-			return std::move(contextOut);
+				if (frame.laneTails[laneIndex] != nullptr)
+				{
+					frame.nHeldLanes++;
+					frame.laneNext[laneIndex] = -1;
+					if (lane.frontFrame < 0)
+					{
+						lane.frontFrame = context.index;
+					}
+					else
+					{
+						frames[lane.backFrame].laneNext[laneIndex] = context.index;
+					}
+					lane.backFrame = context.index;
+				}
+			}
+			frame.retiring = (frame.nHeldLanes == 0);
 		}
 
-		flux_spinlock lock;
-		allocator_t allocator;
-		uniq_ptr<arena_t> arenaA;
-		uniq_ptr<arena_t> arenaB;
-		arena_t* currentAllocator;
+		// Cuts up to nRun signals off the front of the lanes, highest priority first and each 
+		// within what's left of its budget (plus everything from flushFrame, if any), links them
+		// and hands them to functor. Frames that were fully delivered are retired once it returns.
+		template <typename func_t>
+		dispatched_run dispatch_lanes(func_t& functor, size_t(&budgets)[flux_priority_count], size_t nRun, int flushFrame)
+		{
+			signal_t* head = nullptr;
+			signal_t* tail = nullptr;
+			size_t nTaken = 0;
+			for (size_t laneIndex = 0; laneIndex < flux_priority_count; laneIndex++)
+			{
+				size_t& laneBudget = budgets[laneIndex];
+				const signal_span taken = take_from_lane(laneIndex, std::min(laneBudget, nRun), flushFrame);
+				if (taken.first == nullptr)
+				{
+					continue;
+				}
+
+				// a flush can go over, so clamp rather than subtract blindly
+				auto consume = [&](size_t& remaining) 
+				{ 
+					if (remaining != flux_unlimited_budget)
+					{
+						remaining -= std::min(remaining, taken.count);
+					}
+				};
+				consume(laneBudget);
+				consume(nRun);
+				nTaken += taken.count;
+
+				if (head == nullptr)
+				{
+					head = taken.first;
+				}
+				else
+				{
+					tail->next.store(taken.first, std::memory_order_relaxed);
+				}
+				tail = taken.last;
+			}
+
+			auto result = functor(head);
+			for (int index = 0; index < nFrames; index++)
+			{
+				if (frames[index].retiring)
+				{
+					frames[index].retiring = false;
+					retire_frame(index);
+				}
+			}
+			return { result, nTaken };
+		}
+
+		// Detaches (and returns) the front of a lane
+		signal_span take_from_lane(size_t laneIndex, size_t budget, int flushFrame)
+		{
+			signal_lane& lane = lanes[laneIndex];
+			if (lane.head == nullptr)
+			{
+				return {};
+			}
+
+			if (budget == flux_unlimited_budget)
+			{
+				// everything, no need to walk the list. The count is only exact for counted lanes,
+				// but an unlimited take never has a budget to charge it to.
+				const signal_span taken = { lane.head, lane.tail, lane.count };
+				while (lane.frontFrame >= 0)
+				{
+					release_front(laneIndex);
+				}
+				lane.head = nullptr;
+				lane.tail = nullptr;
+				lane.count = 0;
+				return taken;
+			}
+
+			signal_t* last = nullptr;
+			signal_t* signal = lane.head;
+			size_t nTaken = 0;
+			for (; signal != nullptr; nTaken++)
+			{
+				const bool flushing = (flushFrame >= 0 && frames[flushFrame].laneTails[laneIndex] != nullptr);
+				if (nTaken >= budget && !flushing)
+				{
+					break;
+				}
+
+				signal_t* next = signal->next.load(std::memory_order_relaxed);
+				if (signal == frames[lane.frontFrame].laneTails[laneIndex])
+				{
+					release_front(laneIndex);
+				}
+				last = signal;
+				signal = next;
+			}
 
-		//BSTL::Threading::SpinlockT lock;
-		signal_t* head;
-		signal_t* tail;
+			if (last == nullptr)
+			{
+				return {};
+			}
+
+			// the rest stays where it is, only the cut is relinked
+			const signal_span taken = { lane.head, last, nTaken };
+			last->next.store(nullptr, std::memory_order_relaxed);
+			lane.head = signal;
+			lane.count -= nTaken;
+			if (signal == nullptr)
+			{
+				lane.tail = nullptr;
+			}
+			return taken;
+		}
+
+		// The lane's oldest frame has been delivered, move on to the next one that has signals in it
+		void release_front(size_t laneIndex)
+		{
+			signal_lane& lane = lanes[laneIndex];
+			buffer_frame& frame = frames[lane.frontFrame];
+			frame.laneTails[laneIndex] = nullptr;
+			frame.retiring = (--frame.nHeldLanes == 0);
+
+			lane.frontFrame = frame.laneNext[laneIndex];
+			if (lane.frontFrame < 0)
+			{
+				lane.backFrame = -1;
+			}
+		}
+
+		// Resets the drained buffers now or marks them for later, see flux_purge_mode
+		void retire_frame(int index)
+		{
+			buffer_frame& frame = frames[index];
+			const dispatcher_context context = { index, frame.slots };
+			switch (options.purgeMode)
+			{
+			case flux_purge_mode::immediate:
+				purge_frame(context);
+				break;
+			case flux_purge_mode::deferred:
+				frame.state.store(frame_state::dirty, std::memory_order_relaxed);
+				break;
+			case flux_purge_mode::background:
+				frame.state.store(frame_state::purging, std::memory_order_relaxed);
+				options.purgePool->submit([this, context]
+				{
+					purge_frame(context);
+					frames[context.index].state.store(frame_state::clean, std::memory_order_release);
+				});
+				break;
+			}
+		}
+
+		// Makes sure the index'th buffers are purged, consumer only
+		void reclaim_frame(size_t index)
+		{
+			buffer_frame& frame = frames[index];
+			if (frame.state.load(std::memory_order_relaxed) == frame_state::dirty)
+			{
+				purge_frame(dispatcher_context{ static_cast<int>(index), frame.slots });
+				frame.state.store(frame_state::clean, std::memory_order_relaxed);
+				return;
+			}
+
+			// pairs with the release at the end of the background purge
+			for (int spins = 0; frame.state.load(std::memory_order_acquire) == frame_state::purging; spins++)
+			{
+				if (spins < max_writer_spins)
+				{
+					flux_cpu_relax();
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		void purge_frame(const dispatcher_context& context)
+		{
+			for_each_slot(context.slots, [&](producer_slot& slot)
+			{
+				signal_buffer* buffer = slot.buffers[context.index].load(std::memory_order_acquire);
+				if (buffer == nullptr)
+				{
+					return;
+				}
+
+				for (auto& queue : buffer->queues)
+				{
+					queue.reset();
+				}
+				buffer->arena.purge();
+			});
+		}
+
+		template <typename func_t>
+		static void for_each_slot(producer_slot* first, func_t&& functor)
+		{
+			for (producer_slot* slot = first; slot != nullptr; slot = slot->nextSlot)
+			{
+				functor(*slot);
+			}
+		}
+
+		producer_slot& local_slot()
+		{
+			if (!options.perThreadArenas)
+			{
+				return *slots.load(std::memory_order_relaxed);
+			}
+
+			// one-entry cache per thread. Keyed on the dispatcher id rather than its address so
+			// a new dispatcher constructed in the same memory never picks up a dead slot
+			struct slot_cache
+			{
+				unsigned __int64 dispatcherId = 0;
+				producer_slot* slot = nullptr;
+			};
+			static thread_local slot_cache cache;
+
+			if (cache.dispatcherId != dispatcherId)
+			{
+				cache.slot = &find_or_create_slot();
+				cache.dispatcherId = dispatcherId;
+			}
+
+			return *cache.slot;
+		}
+
+		producer_slot& find_or_create_slot()
+		{
+			const std::thread::id self = std::this_thread::get_id();
+			producer_slot* found = nullptr;
+			for_each_slot(slots.load(std::memory_order_acquire), [&](producer_slot& slot)
+			{
+				// ids of finished threads get recycled, which conveniently recycles their slot too
+				if (slot.owner == self)
+				{
+					found = &slot;
+				}
+			});
+
+			if (found != nullptr)
+			{
+				return *found;
+			}
+
+			producer_slot* created = allocator_wrapper_t::template _allocate_one<producer_slot>(allocator, allocator, options);
+			created->owner = self;
+			created->nextSlot = slots.load(std::memory_order_relaxed);
+			while (!slots.compare_exchange_weak(created->nextSlot, created, std::memory_order_seq_cst, std::memory_order_relaxed)) {}
+
+			return *created;
+		}
+
+		static unsigned __int64 next_dispatcher_id()
+		{
+			static std::atomic<unsigned __int64> counter = 1;
+			return counter.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		allocator_t allocator;
+		const flux_dispatcher_options options;
+		const unsigned __int64 dispatcherId;
+		std::atomic<int> currentBuffer;
+		std::atomic<producer_slot*> slots;
+		std::vector<buffer_frame, rebind_alloc_t<buffer_frame>> frames;	// one per buffer, up to maxBuffers
+		// consumer only
+		int nFrames;				// buffers in use, the rest are spares that haven't been needed yet
+		std::uint64_t nSwaps = 0;
+		signal_lane lanes[flux_priority_count];
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,598 @@
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace cxpr_flux
+{
+	namespace __detail
+	{
+		inline unsigned flux_popcount(std::uint32_t bits) noexcept
+		{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+			return __popcnt(bits);
+#elif defined(__GNUC__)
+			return __builtin_popcount(bits);
+#else
+			bits = bits - ((bits >> 1) & 0x55555555);
+			bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+			return (((bits + (bits >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+		}
+
+		// index of the lowest set bit, 32 if there is none
+		inline unsigned flux_lowest_bit(std::uint32_t bits) noexcept
+		{
+			return bits != 0 ? flux_popcount((bits & (0u - bits)) - 1) : 32;
+		}
+
+		template <typename key_t>
+		constexpr std::uint64_t to_trie_index(key_t key) noexcept
+		{
+			if constexpr (std::is_enum_v<key_t>)
+			{
+				return to_trie_index(static_cast<std::underlying_type_t<key_t>>(key));
+			}
+			else
+			{
+				return static_cast<std::uint64_t>(static_cast<std::make_unsigned_t<key_t>>(key));
+			}
+		}
+
+		template <typename key_t>
+		constexpr key_t from_trie_index(std::uint64_t index) noexcept
+		{
+			if constexpr (std::is_enum_v<key_t>)
+			{
+				return static_cast<key_t>(from_trie_index<std::underlying_type_t<key_t>>(index));
+			}
+			else
+			{
+				return static_cast<key_t>(static_cast<std::make_unsigned_t<key_t>>(index));
+			}
+		}
+
+		template <typename T, typename = void>
+		struct is_equality_comparable : std::false_type {};
+
+		template <typename T>
+		struct is_equality_comparable<T, std::void_t<decltype(std::declval<const T&>() == std::declval<const T&>())>> : std::true_type {};
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_changeset
+	// The keys that differ between two versions of a state, each list in the order the state
+	// iterates. For the persistent containers that's ascending as unsigned, so negative keys
+	// come after the positive ones. reset means the state couldn't be diffed and everything
+	// should be treated as changed.
+	template <typename key_t>
+	struct flux_changeset
+	{
+		std::vector<key_t> inserted;
+		std::vector<key_t> removed;
+		std::vector<key_t> updated;
+		bool reset = false;
+
+		bool empty() const noexcept { return !reset && inserted.empty() && removed.empty() && updated.empty(); }
+
+		void clear() noexcept
+		{
+			inserted.clear();
+			removed.clear();
+			updated.clear();
+			reset = false;
+		}
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// persistent_map
+	// Map from integral ids to values with structural sharing, meant to be a store's state_t.
+	// Copying one is O(1) and shares every node, so publishing it to containers is as cheap
+	// as a flux_snapshot. Updates copy only the nodes on the path to the changed id (O(log32 n)),
+	// and only if another copy still holds on to them, otherwise they edit in place.
+	// Internally it's a 32-way trie consuming the id 5 bits at a time from the top. Nodes
+	// only store the slots in use (a bitmap says which, a popcount finds them), and the root
+	// only gets as deep as the largest id needs, a million ids is 4 levels. Iteration visits
+	// ids in ascending order (as unsigned, negative ids come last).
+	// Like flux_state, a map is mutated by a single thread; copies can be read from anywhere.
+	template <typename key_t, typename value_t>
+	class persistent_map
+	{
+		static_assert(std::is_integral_v<key_t> || std::is_enum_v<key_t>, "persistent_map is keyed by integral ids");
+
+		using index_t = std::uint64_t;
+		static constexpr unsigned bits = 5;
+		static constexpr unsigned max_depth = (64 + bits - 1) / bits;
+
+		struct node
+		{
+			std::uint32_t bitmap = 0;
+			std::vector<std::shared_ptr<node>> children; // inner nodes only
+			std::vector<value_t> values; // leaves only
+		};
+		using node_ptr = std::shared_ptr<node>;
+
+	public:
+		using key_type = key_t;
+		using mapped_type = value_t;
+		using changeset_t = flux_changeset<key_t>;
+
+		//////////////////////////////////////////////////////////////////////////
+		// Walks the values in id order, key() gives the id of the current one. Only valid
+		// as long as the map it came from is alive and unchanged (copies keep it alive).
+		class const_iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = value_t;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const value_t*;
+			using reference = const value_t&;
+
+			const_iterator() noexcept = default;
+
+			reference operator*() const noexcept
+			{
+				const frame& top = frames[depth - 1];
+				return top.current->values[top.pos];
+			}
+
+			pointer operator->() const noexcept { return &**this; }
+
+			key_t key() const noexcept
+			{
+				index_t index = 0;
+				for (unsigned i = 0; i < depth; i++)
+				{
+					index = (index << bits) | frames[i].slot;
+				}
+				return __detail::from_trie_index<key_t>(index);
+			}
+
+			const_iterator& operator++() noexcept
+			{
+				step(frames[depth - 1]);
+				settle();
+				return *this;
+			}
+
+			const_iterator operator++(int) noexcept
+			{
+				auto copy = *this;
+				++*this;
+				return copy;
+			}
+
+			bool operator==(const const_iterator& other) const noexcept
+			{
+				// every end iterator has an empty path
+				return depth == other.depth && (depth == 0 ||
+					(frames[depth - 1].current == other.frames[depth - 1].current && frames[depth - 1].pos == other.frames[depth - 1].pos));
+			}
+
+			bool operator!=(const const_iterator& other) const noexcept { return !(*this == other); }
+
+		private:
+			friend class persistent_map;
+
+			struct frame
+			{
+				const node* current;
+				unsigned slot;
+				unsigned pos;
+			};
+
+			const_iterator(const node* root, unsigned rootShift) noexcept : levels(rootShift / bits + 1)
+			{
+				if (root != nullptr)
+				{
+					frames[depth++] = { root, __detail::flux_lowest_bit(root->bitmap), 0 };
+					settle();
+				}
+			}
+
+			static void step(frame& current) noexcept
+			{
+				current.pos++;
+				// 2u << 31 wraps to 0, which correctly leaves nothing after the last slot
+				current.slot = __detail::flux_lowest_bit(current.current->bitmap & ~((2u << current.slot) - 1));
+			}
+
+			// moves down to the next value at or after the current path, or to the end
+			void settle() noexcept
+			{
+				while (depth > 0)
+				{
+					frame& top = frames[depth - 1];
+					if (top.pos >= __detail::flux_popcount(top.current->bitmap))
+					{
+						if (--depth > 0)
+						{
+							step(frames[depth - 1]);
+						}
+					}
+					else if (depth == levels)
+					{
+						return;
+					}
+					else
+					{
+						const node* child = top.current->children[top.pos].get();
+						frames[depth++] = { child, __detail::flux_lowest_bit(child->bitmap), 0 };
+					}
+				}
+			}
+
+			frame frames[max_depth] = {};
+			unsigned depth = 0;
+			unsigned levels = 0;
+		};
+
+		persistent_map() noexcept = default;
+
+		size_t size() const noexcept { return count; }
+		bool empty() const noexcept { return count == 0; }
+
+		// true if both are the same version of the map
+		bool shares(const persistent_map& other) const noexcept { return root == other.root; }
+
+		const_iterator begin() const noexcept { return const_iterator(root.get(), shift); }
+		const_iterator end() const noexcept { return const_iterator(); }
+		const_iterator cbegin() const noexcept { return begin(); }
+		const_iterator cend() const noexcept { return end(); }
+
+		// nullptr if there's no value for key
+		const value_t* find(key_t key) const noexcept
+		{
+			const index_t index = __detail::to_trie_index(key);
+			if (root == nullptr || index > max_index(shift))
+			{
+				return nullptr;
+			}
+
+			const node* current = root.get();
+			for (unsigned level = shift; ; level -= bits)
+			{
+				const std::uint32_t bit = slot_bit(index, level);
+				if ((current->bitmap & bit) == 0)
+				{
+					return nullptr;
+				}
+
+				const unsigned pos = position(current->bitmap, bit);
+				if (level == 0)
+				{
+					return &current->values[pos];
+				}
+				current = current->children[pos].get();
+			}
+		}
+
+		bool contains(key_t key) const noexcept { return find(key) != nullptr; }
+
+		const value_t& at(key_t key) const
+		{
+			if (const value_t* found = find(key))
+			{
+				return *found;
+			}
+			throw std::out_of_range("persistent_map::at");
+		}
+
+		// Inserts or replaces the value for key, returns true if key is new
+		template <typename T>
+		bool set(key_t key, T&& value)
+		{
+			const index_t index = __detail::to_trie_index(key);
+			grow(index);
+			const bool inserted = assoc(root, shift, index, std::forward<T>(value));
+			count += inserted ? 1 : 0;
+			return inserted;
+		}
+
+		// Calls fun with a mutable reference to the value for key, returns false if there isn't one
+		template <typename functor_t>
+		bool update(key_t key, functor_t&& fun)
+		{
+			if (!contains(key))
+			{
+				return false;
+			}
+			fun(edit_value(root, shift, __detail::to_trie_index(key)));
+			return true;
+		}
+
+		bool erase(key_t key)
+		{
+			if (!contains(key))
+			{
+				return false;
+			}
+
+			if (count == 1)
+			{
+				clear();
+				return true;
+			}
+
+			dissoc(root, shift, __detail::to_trie_index(key));
+			count--;
+			// drop levels that only lead to slot 0
+			while (shift > 0 && root->bitmap == 1)
+			{
+				node_ptr child = root->children[0];
+				root = std::move(child);
+				shift -= bits;
+			}
+			return true;
+		}
+
+		void clear() noexcept
+		{
+			root.reset();
+			shift = 0;
+			count = 0;
+		}
+
+		// Appends every key that differs from before. Subtrees both versions still share are
+		// skipped without being looked at, so this is O(changes * log32 n) rather than O(n).
+		// Values in both are compared with == if value_t has one, otherwise every value in a 
+		// leaf that was copied counts as updated.
+		void collect_changes(const persistent_map& before, changeset_t& changes) const
+		{
+			diff({ before.root.get(), before.shift }, { root.get(), shift }, std::max(before.shift, shift), 0, changes);
+		}
+
+	private:
+		struct node_view
+		{
+			const node* current;
+			unsigned level;
+		};
+
+		static std::uint32_t bitmap_at(const node_view& view, unsigned level) noexcept
+		{
+			if (view.current == nullptr)
+			{
+				return 0;
+			}
+			// a root shallower than level sits under slot 0 of the levels above it
+			return level > view.level ? 1u : view.current->bitmap;
+		}
+
+		static node_view child_at(const node_view& view, unsigned level, std::uint32_t bit) noexcept
+		{
+			if ((bitmap_at(view, level) & bit) == 0)
+			{
+				return { nullptr, 0 };
+			}
+			if (level > view.level)
+			{
+				return view;
+			}
+			return { view.current->children[position(view.current->bitmap, bit)].get(), level - bits };
+		}
+
+		static void diff(const node_view& before, const node_view& after, unsigned level, index_t prefix, changeset_t& changes)
+		{
+			if (before.current == after.current && before.level == after.level)
+			{
+				return;
+			}
+
+			const std::uint32_t beforeBits = bitmap_at(before, level);
+			const std::uint32_t afterBits = bitmap_at(after, level);
+			for (std::uint32_t remaining = beforeBits | afterBits; remaining != 0; remaining &= remaining - 1)
+			{
+				const unsigned slot = __detail::flux_lowest_bit(remaining);
+				const std::uint32_t bit = 1u << slot;
+				const index_t index = prefix | (index_t(slot) << level);
+				if (level > 0)
+				{
+					diff(child_at(before, level, bit), child_at(after, level, bit), level - bits, index, changes);
+				}
+				else if ((beforeBits & bit) == 0)
+				{
+					changes.inserted.push_back(__detail::from_trie_index<key_t>(index));
+				}
+				else if ((afterBits & bit) == 0)
+				{
+					changes.removed.push_back(__detail::from_trie_index<key_t>(index));
+				}
+				else if (!same_value(before.current->values[position(beforeBits, bit)], after.current->values[position(afterBits, bit)]))
+				{
+					changes.updated.push_back(__detail::from_trie_index<key_t>(index));
+				}
+			}
+		}
+
+		// only called for values in leaves that were copied, so identity tells us nothing
+		static bool same_value(const value_t& before, const value_t& after)
+		{
+			if constexpr (__detail::is_equality_comparable<value_t>::value)
+			{
+				return before == after;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		static constexpr index_t max_index(unsigned level) noexcept
+		{
+			return level + bits >= 64 ? ~index_t(0) : (index_t(1) << (level + bits)) - 1;
+		}
+
+		static constexpr std::uint32_t slot_bit(index_t index, unsigned level) noexcept
+		{
+			return 1u << ((index >> level) & ((1u << bits) - 1));
+		}
+
+		// where the slot for bit lives in the node's compacted arrays
+		static unsigned position(std::uint32_t bitmap, std::uint32_t bit) noexcept
+		{
+			return __detail::flux_popcount(bitmap & (bit - 1));
+		}
+
+		// Makes current safe to modify, copying it first if anything else shares it. use_count
+		// can only over-report while other threads drop their copies, which at worst costs a
+		// copy we didn't need
+		static node& edit(node_ptr& current)
+		{
+			if (current.use_count() > 1)
+			{
+				current = std::make_shared<node>(*current);
+			}
+			return *current;
+		}
+
+		void grow(index_t index)
+		{
+			if (root == nullptr)
+			{
+				shift = 0;
+				while (index > max_index(shift))
+				{
+					shift += bits;
+				}
+				root = std::make_shared<node>();
+				return;
+			}
+
+			while (index > max_index(shift))
+			{
+				auto parent = std::make_shared<node>();
+				parent->bitmap = 1;
+				parent->children.push_back(std::move(root));
+				root = std::move(parent);
+				shift += bits;
+			}
+		}
+
+		template <typename T>
+		static bool assoc(node_ptr& current, unsigned level, index_t index, T&& value)
+		{
+			node& editable = edit(current);
+			const std::uint32_t bit = slot_bit(index, level);
+			const unsigned pos = position(editable.bitmap, bit);
+			const bool present = (editable.bitmap & bit) != 0;
+			if (level == 0)
+			{
+				if (present)
+				{
+					editable.values[pos] = std::forward<T>(value);
+					return false;
+				}
+				editable.values.insert(editable.values.begin() + pos, std::forward<T>(value));
+				editable.bitmap |= bit;
+				return true;
+			}
+
+			if (!present)
+			{
+				editable.children.insert(editable.children.begin() + pos, std::make_shared<node>());
+				editable.bitmap |= bit;
+			}
+			return assoc(editable.children[pos], level - bits, index, std::forward<T>(value));
+		}
+
+		static value_t& edit_value(node_ptr& current, unsigned level, index_t index)
+		{
+			node& editable = edit(current);
+			const unsigned pos = position(editable.bitmap, slot_bit(index, level));
+			return level == 0 ? editable.values[pos] : edit_value(editable.children[pos], level - bits, index);
+		}
+
+		static void dissoc(node_ptr& current, unsigned level, index_t index)
+		{
+			node& editable = edit(current);
+			const std::uint32_t bit = slot_bit(index, level);
+			const unsigned pos = position(editable.bitmap, bit);
+			if (level == 0)
+			{
+				editable.values.erase(editable.values.begin() + pos);
+				editable.bitmap &= ~bit;
+				return;
+			}
+
+			if (only_holds(*editable.children[pos], level - bits, index))
+			{
+				// the whole subtree goes away, no point copying it first
+				editable.children.erase(editable.children.begin() + pos);
+				editable.bitmap &= ~bit;
+				return;
+			}
+			dissoc(editable.children[pos], level - bits, index);
+		}
+
+		static bool only_holds(const node& current, unsigned level, index_t index) noexcept
+		{
+			if (current.bitmap != slot_bit(index, level))
+			{
+				return false;
+			}
+			return level == 0 || only_holds(*current.children[0], level - bits, index);
+		}
+
+		node_ptr root;
+		unsigned shift = 0;
+		size_t count = 0;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// persistent_vector
+	// Append-only-ish sequence with the same sharing as persistent_map (it is one, keyed by
+	// position): O(1) copies, O(log32 n) push_back/pop_back/set that copy only the path they
+	// touch. There's no insert/erase in the middle, use a persistent_map keyed by id for that.
+	template <typename value_t>
+	class persistent_vector
+	{
+		using map_t = persistent_map<size_t, value_t>;
+
+	public:
+		using value_type = value_t;
+		using const_iterator = typename map_t::const_iterator;
+		using changeset_t = typename map_t::changeset_t;
+
+		persistent_vector() noexcept = default;
+
+		size_t size() const noexcept { return items.size(); }
+		bool empty() const noexcept { return items.empty(); }
+		bool shares(const persistent_vector& other) const noexcept { return items.shares(other.items); }
+
+		const_iterator begin() const noexcept { return items.begin(); }
+		const_iterator end() const noexcept { return items.end(); }
+		const_iterator cbegin() const noexcept { return begin(); }
+		const_iterator cend() const noexcept { return end(); }
+
+		const value_t& operator[](size_t index) const noexcept { return *items.find(index); }
+		const value_t& at(size_t index) const { return items.at(index); }
+		const value_t& front() const noexcept { return (*this)[0]; }
+		const value_t& back() const noexcept { return (*this)[size() - 1]; }
+
+		template <typename T>
+		void push_back(T&& value) { items.set(size(), std::forward<T>(value)); }
+		void pop_back() { items.erase(size() - 1); }
+
+		template <typename T>
+		void set(size_t index, T&& value) { items.set(index, std::forward<T>(value)); }
+
+		template <typename functor_t>
+		void update(size_t index, functor_t&& fun) { items.update(index, std::forward<functor_t>(fun)); }
+
+		void clear() noexcept { items.clear(); }
+
+		// Appends the positions that differ from before, see persistent_map::collect_changes
+		void collect_changes(const persistent_vector& before, changeset_t& changes) const
+		{
+			items.collect_changes(before.items, changes);
+		}
+
+	private:
+		map_t items;
+	};
+}
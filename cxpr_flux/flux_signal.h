@@ -1,36 +1,192 @@
 #pragma once
 
+#include <cstdint>
+
 using namespace cxpr;
 
 namespace cxpr_flux
 {
+	//////////////////////////////////////////////////////////////////////////
+	// flux_signal_index
+	// Compile-time mapping of a fixed payload set to dense indices [0, size). Payload types
+	// outside the set map to invalid_index (== size), so consumers can size lookup tables as
+	// size + 1 and never branch on it.
+	template <typename ... payloads_t>
+	struct flux_signal_index
+	{
+		static constexpr std::uint32_t size = static_cast<std::uint32_t>(sizeof...(payloads_t));
+		static constexpr std::uint32_t invalid_index = size;
+
+		template <typename payload_t>
+		static constexpr std::uint32_t index_of()
+		{
+			constexpr bool matches[] = { std::is_same_v<std::decay_t<payload_t>, payloads_t>..., true };
+			std::uint32_t index = 0;
+			while (!matches[index])
+			{
+				index++;
+			}
+			return index;
+		}
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_priority
+	// Lane a signal is queued in. Lanes are drained highest first, each up to its budget
+	// (see flux_dispatcher_options::laneBudgets). Payloads pick their lane by declaring 
+	//		static constexpr flux_priority priority = flux_priority::high;
+	// anything else goes in the normal lane.
+	enum class flux_priority : std::uint8_t
+	{
+		high,
+		normal,
+		low
+	};
+
+	static constexpr size_t flux_priority_count = 3;
+	static constexpr size_t flux_unlimited_budget = ~size_t(0);
+
+	namespace __detail
+	{
+		template <typename payload_t, typename = void>
+		struct signal_priority : std::integral_constant<flux_priority, flux_priority::normal> {};
+
+		// only a static flux_priority member, payloads are free to have a priority field of their own
+		template <typename payload_t>
+		struct signal_priority<payload_t, std::enable_if_t<
+				std::is_same_v<std::remove_cv_t<decltype(payload_t::priority)>, flux_priority> &&
+				!std::is_member_pointer_v<decltype(&payload_t::priority)>>>
+			: std::integral_constant<flux_priority, payload_t::priority> {};
+	}
+
+	template <typename payload_t>
+	static constexpr flux_priority flux_signal_priority_v = __detail::signal_priority<std::decay_t<payload_t>>::value;
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_signal
+	// Type-erased view of a queued signal. Type information lives inline in the signal so 
+	// reading it is a plain load rather than a virtual call.
 	struct flux_signal
 	{
-		virtual ~flux_signal() = default;
-		virtual const void* payload() const = 0;
-		virtual cxpr::hash_t hash() const = 0;
+		const void* payload() const { return reinterpret_cast<const char*>(this) + payloadOffset; }
+		cxpr::hash_t hash() const { return typeHash; }
+		std::uint32_t index() const { return typeIndex; }	// dense index from the dispatcher's flux_signal_index
+
+	protected:
+		cxpr::hash_t typeHash = 0;
+		std::uint32_t typeIndex = 0;
+		std::uint32_t payloadOffset = 0;
 	};
 
 	//////////////////////////////////////////////////////////////////////////
 
 	struct flux_signal_node : public flux_signal
 	{
-		flux_signal_node* next = nullptr;
+		std::atomic<flux_signal_node*> next = nullptr;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_signal_run
+	// Iterable view over a null-terminated list of signals that all carry payload_t
+	template <typename payload_t>
+	struct flux_signal_run
+	{
+		struct iterator
+		{
+			const payload_t& operator*() const { return *static_cast<const payload_t*>(node->payload()); }
+			iterator& operator++() { node = node->next.load(std::memory_order_relaxed); return *this; }
+			bool operator!=(const iterator& other) const { return node != other.node; }
+
+			const flux_signal_node* node;
+		};
+
+		iterator begin() const { return { first }; }
+		iterator end() const { return { nullptr }; }
+
+		const flux_signal_node* first = nullptr;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_signal_queue
+	// Intrusive multi-producer/single-consumer queue linked through flux_signal_node::next.
+	// Producers append with a single atomic exchange on the tail followed by a store into
+	// their predecessor, so enqueue is wait-free and never contends with the consumer. 
+	// Between those two steps the list is briefly unlinked, so the consumer must only walk 
+	// the queue once every producer that could be pushing into it has finished (see 
+	// flux_dispatcher::swap_state).
+	struct flux_signal_queue
+	{
+		void push(flux_signal_node* node) noexcept { push_range(node, node); }
+
+		// Appends a run that the caller already linked together (first -> ... -> last)
+		void push_range(flux_signal_node* first, flux_signal_node* last) noexcept
+		{
+			last->next.store(nullptr, std::memory_order_relaxed);
+			flux_signal_node* prev = tail.exchange(last, std::memory_order_acq_rel);
+			if (prev == nullptr)
+			{
+				head.store(first, std::memory_order_release);
+			}
+			else
+			{
+				prev->next.store(first, std::memory_order_release);
+			}
+		}
+
+		flux_signal_node* front() const noexcept { return head.load(std::memory_order_acquire); }
+		flux_signal_node* back() const noexcept { return tail.load(std::memory_order_acquire); }
+
+		// consumer only, producers must be quiesced
+		void reset() noexcept
+		{
+			head.store(nullptr, std::memory_order_relaxed);
+			tail.store(nullptr, std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<flux_signal_node*> head = nullptr;
+		std::atomic<flux_signal_node*> tail = nullptr;
 	};
 
 	//////////////////////////////////////////////////////////////////////////
 
+	namespace __detail
+	{
+		template <typename ... params_t>
+		struct leads_with_allocator_arg : std::false_type {};
+
+		template <typename first_t, typename ... rest_t>
+		struct leads_with_allocator_arg<first_t, rest_t...> : std::is_same<std::decay_t<first_t>, std::allocator_arg_t> {};
+	}
+	//////////////////////////////////////////////////////////////////////////
+
 	template <typename dispatcher_t, typename payload_t>
 	struct flux_signal_impl : public flux_signal_node
 	{
-		template <typename ... params_t>
-		flux_signal_impl(params_t&& ... params) : data(std::forward<params_t>(params)...) {}
+		template <typename ... params_t, typename = std::enable_if_t<!__detail::leads_with_allocator_arg<params_t...>::value>>
+		flux_signal_impl(params_t&& ... params) : data(std::forward<params_t>(params)...)
+		{
+			init_header();
+		}
 
-		virtual ~flux_signal_impl() = default;
-		virtual const void* payload() const override { return &data; }
-		virtual cxpr::hash_t hash() const override { return cxpr::typehash_v<payload_t>; }
+		// Builds the payload with uses-allocator construction, see make_using_allocator
+		template <typename alloc_t, typename ... params_t>
+		flux_signal_impl(std::allocator_arg_t, const alloc_t& alloc, params_t&& ... params) 
+			: data(make_using_allocator<payload_t>(alloc, std::forward<params_t>(params)...))
+		{
+			init_header();
+		}
 
 		payload_t data;
+
+	private:
+		void init_header()
+		{
+			typeHash = cxpr::typehash_v<payload_t>;
+			typeIndex = dispatcher_t::signal_index_t::template index_of<payload_t>();
+			payloadOffset = static_cast<std::uint32_t>(reinterpret_cast<const char*>(&data) 
+				- reinterpret_cast<const char*>(static_cast<const flux_signal*>(this)));
+		}
 	};
 
 	//////////////////////////////////////////////////////////////////////////
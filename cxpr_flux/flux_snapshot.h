@@ -0,0 +1,95 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace cxpr_flux
+{
+	//////////////////////////////////////////////////////////////////////////
+	// flux_snapshot
+	// Immutable, refcounted view of a store's state at the time it was taken. Copying one is
+	// a refcount bump, so stores can hand them to any number of containers without copying
+	// the state itself. An empty snapshot reads as a default constructed T.
+	template <typename T>
+	class flux_snapshot
+	{
+	public:
+		using value_type = T;
+
+		flux_snapshot() noexcept = default;
+		explicit flux_snapshot(std::shared_ptr<const T> _data) noexcept : data(std::move(_data)) {}
+
+		const T& get() const noexcept { return data != nullptr ? *data : empty(); }
+		const T& operator*() const noexcept { return get(); }
+		const T* operator->() const noexcept { return &get(); }
+		operator const T&() const noexcept { return get(); }
+
+		// true if both refer to the same version of the state
+		bool shares(const flux_snapshot& other) const noexcept { return data == other.data; }
+
+	private:
+		static const T& empty() noexcept
+		{
+			static const T emptyState = {};
+			return emptyState;
+		}
+
+		std::shared_ptr<const T> data;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_state
+	// Copy-on-write holder for a store's state. snapshot() shares the current version, write()
+	// only copies it if a snapshot is still holding on to it, so a store that publishes after
+	// every change pays for at most one copy per change and none if nobody kept the old one.
+	// Owned and mutated by a single thread (the one dispatching to the store), snapshots can
+	// be read from anywhere.
+	template <typename T>
+	class flux_state
+	{
+	public:
+		flux_state() : current(std::make_shared<T>()) {}
+		explicit flux_state(T initial) : current(std::make_shared<T>(std::move(initial))) {}
+
+		flux_state(flux_state&& other) noexcept = default;
+		flux_state& operator=(flux_state&& other) noexcept = default;
+
+		const T& read() const noexcept { return *current; }
+
+		T& write()
+		{
+			// use_count can only over-report while other threads drop snapshots, which at
+			// worst costs a copy we didn't need
+			if (current.use_count() > 1)
+			{
+				current = std::make_shared<T>(*current);
+			}
+			return *current;
+		}
+
+		flux_snapshot<T> snapshot() const noexcept { return flux_snapshot<T>(current); }
+
+	private:
+		std::shared_ptr<T> current;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+
+	namespace __detail
+	{
+		template <typename T>
+		struct unwrap_snapshot { using type = T; };
+
+		template <typename T>
+		struct unwrap_snapshot<flux_snapshot<T>> { using type = T; };
+
+		// whatever store_t::getState() hands out, either a state_t copy or a flux_snapshot
+		template <typename store_t>
+		using published_state_t = std::decay_t<decltype(std::declval<const store_t&>().getState())>;
+
+		template <typename T>
+		const T& unwrap_state(const T& state) { return state; }
+
+		template <typename T>
+		const T& unwrap_state(const flux_snapshot<T>& state) { return state.get(); }
+	}
+}
@@ -1,5 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64))
+#include <intrin.h>
+#endif
+
+#if !defined(__cpp_lib_atomic_wait)
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 
 namespace cxpr_flux
@@ -7,26 +25,223 @@ namespace cxpr_flux
 	static constexpr bool SpinlockUnlocked = false;
 	static constexpr bool SpinlockLocked = true;
 
+	// Tells the core we're spinning, so it can back off the pipeline/hand the core to the
+	// sibling hyperthread instead of burning through the loop
+	inline void flux_cpu_relax() noexcept
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+		__yield();
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+		asm volatile("yield");
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	namespace __detail
+	{
+		//////////////////////////////////////////////////////////////////////////
+		// Sleeps while word == expected, wakes on flux_unpark_one. Spurious wakeups are allowed,
+		// callers recheck. std::atomic::wait in C++20, a futex on Linux, otherwise a mutex + 
+		// condition variable from a small table shared by all addresses.
+#if defined(__cpp_lib_atomic_wait)
+		inline void flux_park(std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept
+		{
+			word.wait(expected, std::memory_order_relaxed);
+		}
+
+		inline void flux_unpark_one(std::atomic<std::uint32_t>& word) noexcept
+		{
+			word.notify_one();
+		}
+#elif defined(__linux__)
+		static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex needs a plain 32 bit word");
+
+		inline void flux_park(std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept
+		{
+			syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+		}
+
+		inline void flux_unpark_one(std::atomic<std::uint32_t>& word) noexcept
+		{
+			syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+		}
+#else
+		struct flux_parking_slot
+		{
+			std::mutex mutex;
+			std::condition_variable wake;
+		};
+
+		inline flux_parking_slot& parking_slot_for(const void* address) noexcept
+		{
+			static flux_parking_slot slots[16];
+			return slots[(reinterpret_cast<std::uintptr_t>(address) / alignof(std::uint64_t)) % std::size(slots)];
+		}
+
+		inline void flux_park(std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept
+		{
+			flux_parking_slot& slot = parking_slot_for(&word);
+			std::unique_lock<std::mutex> ll(slot.mutex);
+			if (word.load(std::memory_order_relaxed) == expected)
+			{
+				slot.wake.wait(ll);
+			}
+		}
+
+		inline void flux_unpark_one(std::atomic<std::uint32_t>& word) noexcept
+		{
+			// taking the mutex orders the wake after a waiter's check, so it can't be missed.
+			// Slots are shared, everyone on it rechecks their own word
+			flux_parking_slot& slot = parking_slot_for(&word);
+			{
+				std::lock_guard<std::mutex> ll(slot.mutex);
+			}
+			slot.wake.notify_all();
+		}
+#endif
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_spinlock
+	// Adaptive lock for short critical sections. Uncontended it's a single CAS to lock and an
+	// exchange to unlock. Under contention it spins on a plain load (test-and-test-and-set,
+	// so waiters share the cache line instead of bouncing it) with a pause and exponential
+	// backoff, then parks after a bounded spin: the thread sleeps on the lock word until
+	// unlock wakes it (see __detail::flux_park).
+	// stats() tells how often lockers had to spin or park, if parks are common the critical
+	// section is too long for a spinlock.
 	struct flux_spinlock
 	{
-		constexpr flux_spinlock(bool initial_state = SpinlockUnlocked) : lock(initial_state) {}
-		std::atomic_bool lock;
+		static constexpr unsigned max_backoff = 64;	// pauses between checks
+		static constexpr unsigned max_spins = 1024;	// pauses before parking
+
+		struct contention_stats
+		{
+			std::uint64_t acquisitions;
+			std::uint64_t contended;	// had to wait at all
+			std::uint64_t parked;		// waited past the spin budget
+			std::uint64_t sleeps;		// times parked lockers went to sleep, about one per park unless they keep losing the race
+		};
+
+		constexpr flux_spinlock(bool initial_state = SpinlockUnlocked) noexcept
+			: state(initial_state ? locked : unlocked) {}
+
+		flux_spinlock(const flux_spinlock&) = delete;
+		flux_spinlock& operator=(const flux_spinlock&) = delete;
+
+		void lock() noexcept
+		{
+			std::uint32_t expected = unlocked;
+			if (!state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				lock_contended();
+			}
+			// only the holder writes the counters, no need for atomic increments
+			bump(acquisitions);
+		}
+
+		bool try_lock() noexcept
+		{
+			std::uint32_t expected = unlocked;
+			if (state.load(std::memory_order_relaxed) == unlocked &&
+				state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				bump(acquisitions);
+				return true;
+			}
+			return false;
+		}
+
+		void unlock() noexcept
+		{
+			if (state.exchange(unlocked, std::memory_order_release) == locked_parked)
+			{
+				__detail::flux_unpark_one(state);
+			}
+		}
+
+		contention_stats stats() const noexcept
+		{
+			return { acquisitions.load(std::memory_order_relaxed), contended.load(std::memory_order_relaxed),
+				parked.load(std::memory_order_relaxed), sleeps.load(std::memory_order_relaxed) };
+		}
+
+		void reset_stats() noexcept
+		{
+			lock();
+			acquisitions.store(0, std::memory_order_relaxed);
+			contended.store(0, std::memory_order_relaxed);
+			parked.store(0, std::memory_order_relaxed);
+			sleeps.store(0, std::memory_order_relaxed);
+			unlock();
+		}
 
 		struct scoped_spinlock
 		{
 			scoped_spinlock(flux_spinlock& _flagRef) : flagRef(_flagRef)
 			{
-				while (flagRef.lock.exchange(true) == true) {}
+				flagRef.lock();
 			}
 
-			~scoped_spinlock() { flagRef.lock.store(false); }
+			~scoped_spinlock() { flagRef.unlock(); }
 
 		private:
 			flux_spinlock& flagRef;
 		};
 
 		[[nodiscard]] decltype(auto) scoped_lock() { return scoped_spinlock(*this); }
-	};
 
-	
-}
\ No newline at end of file
+	private:
+		static constexpr std::uint32_t unlocked = 0;
+		static constexpr std::uint32_t locked = 1;
+		static constexpr std::uint32_t locked_parked = 2;	// someone may be waiting, unlock has to wake them
+
+		static void bump(std::atomic<std::uint64_t>& counter) noexcept
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		void lock_contended() noexcept
+		{
+			unsigned backoff = 1;
+			for (unsigned spins = 0; spins < max_spins; spins += backoff, backoff = std::min(backoff * 2, max_backoff))
+			{
+				for (unsigned i = 0; i < backoff; i++)
+				{
+					flux_cpu_relax();
+				}
+
+				std::uint32_t expected = unlocked;
+				if (state.load(std::memory_order_relaxed) == unlocked &&
+					state.compare_exchange_weak(expected, locked, std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					bump(contended);
+					return;
+				}
+			}
+
+			// Out of spins, park. Taking the lock as locked_parked (we can't tell if others are
+			// still parked) costs at most one needless wake on our unlock
+			std::uint64_t nSleeps = 0;
+			while (state.exchange(locked_parked, std::memory_order_acquire) != unlocked)
+			{
+				__detail::flux_park(state, locked_parked);
+				nSleeps++;
+			}
+			bump(contended);
+			bump(parked);
+			sleeps.store(sleeps.load(std::memory_order_relaxed) + nSleeps, std::memory_order_relaxed);
+		}
+
+		std::atomic<std::uint32_t> state;
+		std::atomic<std::uint64_t> acquisitions{ 0 };
+		std::atomic<std::uint64_t> contended{ 0 };
+		std::atomic<std::uint64_t> parked{ 0 };
+		std::atomic<std::uint64_t> sleeps{ 0 };
+	};
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace cxpr_flux
+{
+	//////////////////////////////////////////////////////////////////////////
+	// flux_thread_pool
+	// Small work-stealing pool. Every worker owns a deque of tasks, popping its own work LIFO
+	// and stealing FIFO from the other workers when it runs dry. Tasks are flux_big_callbacks
+	// so submitting never allocates beyond the deque itself. Tasks must not throw. Tasks still
+	// queued when the pool is destroyed are run before the destructor returns.
+	class flux_thread_pool
+	{
+	public:
+		using task_t = flux_big_callback<void()>;
+
+		explicit flux_thread_pool(size_t nWorkers = std::thread::hardware_concurrency())
+			: queues(nWorkers > 0 ? nWorkers : 1)
+		{
+			workers.reserve(queues.size());
+			for (size_t index = 0; index < queues.size(); index++)
+			{
+				workers.emplace_back([this, index] { worker_loop(index); });
+			}
+		}
+
+		~flux_thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> ll(sleepLock);
+				stopping = true;
+			}
+			sleepSignal.notify_all();
+			for (auto& worker : workers)
+			{
+				worker.join();
+			}
+		}
+
+		flux_thread_pool(const flux_thread_pool&) = delete;
+		flux_thread_pool& operator=(const flux_thread_pool&) = delete;
+
+		size_t size() const noexcept { return workers.size(); }
+
+		template <typename lambda_t>
+		void submit(lambda_t&& lam)
+		{
+			// spread external submissions round-robin, the workers even it out by stealing
+			worker_queue& queue = queues[nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+			// counted before it can be popped, so the pop's decrement never runs ahead of us
+			pending.fetch_add(1, std::memory_order_release);
+			{
+				auto ll = queue.lock.scoped_lock();
+				queue.tasks.emplace_back().bind_lambda(std::forward<lambda_t>(lam));
+			}
+
+			{	// taking the lock orders us against a worker checking pending before it sleeps
+				std::lock_guard<std::mutex> ll(sleepLock);
+			}
+			sleepSignal.notify_one();
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// parallel_for
+		// Runs functor(i) for every i in [0, count) on the pool and returns once all of them
+		// are done. The calling thread helps out instead of blocking, so it's safe to call from
+		// inside a task.
+		template <typename func_t>
+		void parallel_for(size_t count, func_t&& functor)
+		{
+			std::atomic<size_t> remaining = count;
+			for (size_t i = 0; i < count; i++)
+			{
+				submit([&functor, &remaining, i]
+				{
+					functor(i);
+					remaining.fetch_sub(1, std::memory_order_release);
+				});
+			}
+
+			while (remaining.load(std::memory_order_acquire) != 0)
+			{
+				if (!run_one(nextQueue.load(std::memory_order_relaxed)))
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	private:
+		struct worker_queue
+		{
+			flux_spinlock lock;
+			std::deque<task_t> tasks;
+		};
+
+		// Pops from the back of our own queue, then tries to steal from the front of the others
+		bool try_pop(size_t self, task_t& out)
+		{
+			for (size_t offset = 0; offset < queues.size(); offset++)
+			{
+				worker_queue& queue = queues[(self + offset) % queues.size()];
+				auto ll = queue.lock.scoped_lock();
+				if (!queue.tasks.empty())
+				{
+					if (offset == 0)
+					{
+						out = std::move(queue.tasks.back());
+						queue.tasks.pop_back();
+					}
+					else
+					{
+						out = std::move(queue.tasks.front());
+						queue.tasks.pop_front();
+					}
+					pending.fetch_sub(1, std::memory_order_relaxed);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		bool run_one(size_t self)
+		{
+			task_t task;
+			if (try_pop(self, task))
+			{
+				task();
+				return true;
+			}
+			return false;
+		}
+
+		void worker_loop(size_t self)
+		{
+			while (true)
+			{
+				if (run_one(self))
+				{
+					continue;
+				}
+
+				// stopping only ends the loop once everything queued has run
+				std::unique_lock<std::mutex> ll(sleepLock);
+				sleepSignal.wait(ll, [this] { return stopping || pending.load(std::memory_order_acquire) > 0; });
+				if (stopping && pending.load(std::memory_order_acquire) == 0)
+				{
+					return;
+				}
+			}
+		}
+
+		std::vector<worker_queue> queues;
+		std::vector<std::thread> workers;
+		std::atomic<size_t> nextQueue = 0;
+		std::atomic<size_t> pending = 0;	// tasks queued but not yet picked up
+		std::mutex sleepLock;
+		std::condition_variable sleepSignal;
+		bool stopping = false;
+	};
+}
@@ -7,6 +7,110 @@
 
 using namespace cxpr;
 
+//////////////////////////////////////////////////////////////////////////
+
+namespace counter_test
+{
+	namespace signals
+	{
+		struct increment
+		{
+			int sequence;
+		};
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Counts increments, and how many of them arrived out of order
+	struct CounterStore : public cxpr_flux::flux_store<CounterStore>
+	{
+		using cxpr_flux::flux_store<CounterStore>::flux_store;
+		using state_t = int;
+
+		static constexpr decltype(auto) GetCallbacks()
+		{
+			return std::make_tuple
+			(
+				cxpr_flux::make_callback<signals::increment>
+				(
+					[](CounterStore& self, const signals::increment& changes, auto& context)
+					{
+						if (changes.sequence == self.count)
+						{
+							self.count++;
+						}
+						else
+						{
+							self.outOfOrder++;
+						}
+						self.emitChanged();
+						return true;
+					}
+				)
+			);
+		}
+
+		int count = 0;
+		int outOfOrder = 0;
+	};
+}
+
+namespace routing_test
+{
+	namespace signals
+	{
+		// keyed, only reaches the entity it names
+		struct damage
+		{
+			int entity;
+			int amount;
+
+			int routingKey() const { return entity; }
+		};
+
+		// not keyed, every entity gets it
+		struct heal
+		{
+			int amount;
+		};
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+
+	struct EntityStore : public cxpr_flux::flux_store<EntityStore>
+	{
+		using state_t = int;
+
+		EntityStore(int _id) : id(_id) {}
+
+		int routingKey() const { return id; }
+
+		static constexpr decltype(auto) GetCallbacks()
+		{
+			return std::make_tuple
+			(
+				cxpr_flux::make_callback<signals::damage>
+				(
+					[](EntityStore& self, const signals::damage& changes, auto& context)
+					{
+						EXPECT_EQ(changes.entity, self.id);
+						self.health -= changes.amount;
+					}
+				),
+				cxpr_flux::make_callback<signals::heal>
+				(
+					[](EntityStore& self, const signals::heal& changes, auto& context)
+					{
+						self.health += changes.amount;
+					}
+				)
+			);
+		}
+
+		int id = 0;
+		int health = 100;
+	};
+}
+
 //////////////////////////////////////////////////////////////////////////
 // This test implements facebooks' basic todo flux example
 // https://github.com/facebook/flux/tree/master/examples/flux-todomvc
@@ -90,6 +194,357 @@ TEST(flux_tests, todo_test)
 
 //////////////////////////////////////////////////////////////////////////
 
+TEST(flux_tests, todo_grouped_test)
+{
+	using namespace cxpr_flux;
+	using namespace todo_test;
+
+	using context_t = cxpr_flux::flux_static_context<std::allocator<void>, TodoStore>;
+	context_t ctx;
+	auto appContainer = cxpr_flux::create_container_view<AppContainer, AppView>(ctx);
+
+	for (int i = 0; i < 100; i++)
+	{
+		ctx.getDispatcher().signal(
+			signals::addTodo{ std::string("New Signal ") + std::to_string(i) }
+		);
+	}
+	auto [nDispatched, nHandled] = ctx.processSignalsGrouped();
+	EXPECT_EQ(nDispatched, 100);
+	EXPECT_EQ(nHandled, 100);
+	{	// grouping keeps the order within a type
+		auto view = appContainer.Render();
+		EXPECT_EQ(view.views.size(), 100);
+		EXPECT_EQ(view.views[0].text, "New Signal 0");
+		EXPECT_EQ(view.views[99].text, "New Signal 99");
+		for (int i = 0; i < 100; i += 2)
+		{
+			view.views[i].onToggle();
+		}
+		view.views[1].onDelete();
+	}
+
+	// signals carry their dense type index inline
+	EXPECT_NE(context_t::signal_index_t::index_of<signals::toggleTodo>(), context_t::signal_index_t::invalid_index);
+	EXPECT_EQ(context_t::signal_index_t::index_of<int>(), context_t::signal_index_t::invalid_index);
+
+	std::tie(nDispatched, nHandled) = ctx.processSignalsGrouped();
+	EXPECT_EQ(nDispatched, 51);
+	{
+		auto view = appContainer.Render();
+		EXPECT_EQ(view.views.size(), 99);
+		EXPECT_TRUE(view.views[0].complete);
+		EXPECT_EQ(view.views[1].text, "New Signal 2");
+		EXPECT_TRUE(view.views[1].complete);
+		EXPECT_FALSE(view.views[2].complete);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_tests, coalesced_changes_test)
+{
+	using namespace cxpr_flux;
+	using namespace todo_test;
+
+	cxpr_flux::flux_static_context<std::allocator<void>, TodoStore, counter_test::CounterStore> ctx;
+	auto appContainer = cxpr_flux::create_container_view<AppContainer, AppView>(ctx);
+	int nNotified = 0;
+	appContainer.addListener(&nNotified, [&] { nNotified++; });
+
+	// every addTodo emits twice, the container still only hears about it once per pass
+	for (int i = 0; i < 100; i++)
+	{
+		ctx.getDispatcher().signal(signals::addTodo{ std::to_string(i) });
+	}
+	ctx.processSignals();
+	EXPECT_EQ(nNotified, 1);
+	EXPECT_TRUE(appContainer.getResetDirty());
+	EXPECT_FALSE(appContainer.getResetDirty());
+	EXPECT_EQ(appContainer.getState<TodoStore>().size(), 100);
+
+	for (int i = 0; i < 100; i++)
+	{
+		ctx.getDispatcher().signal(signals::toggleTodo{ i });
+	}
+	ctx.processSignalsGrouped();
+	EXPECT_EQ(nNotified, 2);
+	EXPECT_TRUE(appContainer.getState<TodoStore>().at(99).complete);
+
+	// nothing changed, nothing to flush
+	ctx.processSignals();
+	EXPECT_EQ(nNotified, 2);
+
+	// parallel passes flush every shard on the calling thread once the pool is done
+	cxpr_flux::flux_thread_pool pool(4);
+	const auto caller = std::this_thread::get_id();
+	int nCounterNotified = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		ctx.getStores().createStore<counter_test::CounterStore>()->addListener(&nCounterNotified, 
+			[&](const counter_test::CounterStore& store)
+			{
+				EXPECT_EQ(std::this_thread::get_id(), caller);
+				EXPECT_EQ(store.count, 50);
+				nCounterNotified++;
+			});
+	}
+	for (int i = 0; i < 50; i++)
+	{
+		ctx.getDispatcher().signal(counter_test::signals::increment{ i });
+	}
+	ctx.processSignalsParallel(pool, 2);
+	EXPECT_EQ(nCounterNotified, 8);
+	EXPECT_EQ(nNotified, 2);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_tests, budgeted_dispatch_test)
+{
+	using namespace counter_test;
+	static constexpr int nSignals = 10000;
+	static constexpr int nBudget = 1000;
+
+	cxpr_flux::flux_static_context<std::allocator<void>, CounterStore> ctx;
+	auto counter = ctx.getStores().createStore<CounterStore>();
+	int nNotified = 0;
+	counter->addListener(&nNotified, [&](const CounterStore&) { nNotified++; });
+
+	ctx.getDispatcher().signal_batch<signals::increment>(nSignals, [](size_t i) { return signals::increment{ static_cast<int>(i) }; });
+
+	// a burst spread over a few frames, in order and nothing is lost
+	cxpr_flux::flux_dispatch_budget budget = {};
+	budget.maxSignals = nBudget;
+	for (int frame = 1; frame <= 3; frame++)
+	{
+		const auto result = ctx.processSignals(budget);
+		EXPECT_EQ(result.nDispatched, nBudget);
+		EXPECT_EQ(result.nRemaining, nSignals - frame * nBudget);
+		EXPECT_EQ(counter->count, frame * nBudget);
+		EXPECT_EQ(nNotified, frame);
+	}
+
+	// signals raised meanwhile are taken in on the next call, behind the backlog
+	ctx.getDispatcher().signal(signals::increment{ nSignals });
+
+	// a deadline that's already passed still lets one run through
+	budget = {};
+	budget.deadline = std::chrono::steady_clock::now();
+	budget.deadlineInterval = 100;
+	auto result = ctx.processSignals(budget);
+	EXPECT_EQ(result.nDispatched, 100);
+	EXPECT_EQ(result.nRemaining, nSignals - 3 * nBudget - 100 + 1);
+
+	// a generous one gets through everything
+	budget.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+	result = ctx.processSignals(budget);
+	EXPECT_EQ(result.nRemaining, 0);
+	EXPECT_EQ(counter->count, nSignals + 1);
+	result = ctx.processSignals(budget);
+	EXPECT_EQ(result.nDispatched, 0);
+	EXPECT_EQ(counter->outOfOrder, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_tests, incremental_view_test)
+{
+	using namespace cxpr_flux;
+	using namespace todo_test;
+
+	cxpr_flux::flux_static_context<std::allocator<void>, TodoStore> ctx;
+	auto appContainer = cxpr_flux::create_container_view<AppContainer, AppView>(ctx);
+	for (const char* text : { "a", "b", "c" })
+	{
+		ctx.getDispatcher().signal(signals::addTodo{ text });
+	}
+	ctx.processSignals();
+	EXPECT_EQ(appContainer.getChanges<TodoStore>().inserted, (std::vector<int>{ 0, 1, 2 }));
+
+	auto view = appContainer.Render();
+	EXPECT_TRUE(appContainer.getChanges<TodoStore>().empty());
+
+	// only the toggled todo shows up
+	view.views[1].onToggle();
+	ctx.processSignals();
+	{
+		auto changes = appContainer.getChanges<TodoStore>();
+		EXPECT_EQ(changes.updated, (std::vector<int>{ 1 }));
+		EXPECT_TRUE(changes.inserted.empty());
+		EXPECT_TRUE(changes.removed.empty());
+	}
+	appContainer.Update(view);
+	EXPECT_TRUE(view.views[1].complete);
+	EXPECT_TRUE(appContainer.getChanges<TodoStore>().empty());
+
+	// changes add up over passes until the view takes them, a todo added and deleted in
+	// between never shows up
+	view.views[0].onDelete();
+	ctx.getDispatcher().signal(signals::addTodo{ "d" });
+	ctx.getDispatcher().signal(signals::addTodo{ "e" });
+	ctx.processSignals();
+	ctx.getDispatcher().signal(signals::deleteTodo{ 4 });
+	ctx.processSignals();
+	{
+		auto changes = appContainer.getChanges<TodoStore>();
+		EXPECT_EQ(changes.removed, (std::vector<int>{ 0 }));
+		EXPECT_EQ(changes.inserted, (std::vector<int>{ 3 }));
+		EXPECT_TRUE(changes.updated.empty());
+	}
+
+	// the patched view matches a fresh one
+	appContainer.Update(view);
+	auto fresh = appContainer.Render();
+	ASSERT_EQ(view.views.size(), fresh.views.size());
+	for (size_t i = 0; i < fresh.views.size(); i++)
+	{
+		EXPECT_EQ(view.views[i].id, fresh.views[i].id);
+		EXPECT_EQ(view.views[i].text, fresh.views[i].text);
+		EXPECT_EQ(view.views[i].complete, fresh.views[i].complete);
+	}
+
+	// and its rows still signal the right todo
+	view.views[0].onToggle();
+	ctx.processSignals();
+	EXPECT_EQ(appContainer.getChanges<TodoStore>().updated, (std::vector<int>{ 1 }));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_tests, arena_context_test)
+{
+	using namespace cxpr_flux;
+	using namespace todo_test;
+	using frame_arena_t = cxpr_flux::arena_allocator<std::allocator<void>, 1024 * 64>;
+	using allocator_t = cxpr_flux::arena_stl_allocator<void, frame_arena_t>;
+
+	// the whole context (dispatcher slabs, store deque, callback lists) lives in one arena
+	frame_arena_t frameArena;
+	{
+		cxpr_flux::flux_static_context<allocator_t, TodoStore> ctx{ allocator_t(frameArena) };
+		auto appContainer = cxpr_flux::create_container_view<AppContainer, AppView>(ctx);
+
+		for (int i = 0; i < 10; i++)
+		{
+			ctx.getDispatcher().signal(signals::addTodo{ std::string("New Signal ") + std::to_string(i) });
+		}
+		auto [nDispatched, nHandled] = ctx.processSignals();
+		EXPECT_EQ(nHandled, 10);
+
+		auto view = appContainer.Render();
+		EXPECT_EQ(view.views.size(), 10);
+		EXPECT_EQ(view.views[9].text, "New Signal 9");
+	}
+	EXPECT_GT(frameArena.capacity(), 0);
+	frameArena.purge();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_tests, parallel_dispatch_test)
+{
+	using namespace cxpr_flux;
+	static constexpr int nCounters = 200;
+	static constexpr int nIncrements = 1000;
+
+	cxpr_flux::flux_thread_pool pool(4);
+	cxpr_flux::flux_static_context<std::allocator<void>, todo_test::TodoStore, counter_test::CounterStore> ctx;
+	auto appContainer = cxpr_flux::create_container_view<todo_test::AppContainer, todo_test::AppView>(ctx);
+
+	std::vector<counter_test::CounterStore*> counters;
+	for (int i = 0; i < nCounters; i++)
+	{
+		counters.push_back(ctx.getStores().createStore<counter_test::CounterStore>());
+	}
+
+	for (int i = 0; i < nIncrements; i++)
+	{
+		ctx.getDispatcher().signal(counter_test::signals::increment{ i });
+		if (i % 10 == 0)
+		{
+			ctx.getDispatcher().signal(todo_test::signals::addTodo{ std::to_string(i) });
+		}
+	}
+
+	auto [nDispatched, nHandled] = ctx.processSignalsParallel(pool, 16);
+	EXPECT_EQ(nDispatched, nIncrements + nIncrements / 10);
+	EXPECT_EQ(nHandled, nCounters * nIncrements + nIncrements / 10);
+
+	// every counter saw every increment, in order
+	for (const auto counter : counters)
+	{
+		EXPECT_EQ(counter->count, nIncrements);
+		EXPECT_EQ(counter->outOfOrder, 0);
+	}
+
+	auto view = appContainer.Render();
+	EXPECT_EQ(view.views.size(), nIncrements / 10);
+	EXPECT_EQ(view.views[1].text, "10");
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_tests, routed_dispatch_test)
+{
+	using namespace routing_test;
+	static constexpr int nEntities = 100;
+
+	cxpr_flux::flux_thread_pool pool(4);
+	cxpr_flux::flux_static_context<std::allocator<void>, EntityStore> ctx;
+	std::vector<EntityStore*> entities;
+	for (int i = 0; i < nEntities; i++)
+	{
+		entities.push_back(ctx.getStores().createStore<EntityStore>(i));
+	}
+
+	// keyed signals hit one instance each, unkeyed ones still broadcast
+	for (int i = 0; i < nEntities; i++)
+	{
+		ctx.getDispatcher().signal(signals::damage{ i, i });
+	}
+	ctx.getDispatcher().signal(signals::damage{ nEntities, 1 });	// no owner, dropped
+	ctx.getDispatcher().signal(signals::heal{ 5 });
+
+	auto [nDispatched, nHandled] = ctx.processSignals();
+	EXPECT_EQ(nDispatched, nEntities + 2);
+	EXPECT_EQ(nHandled, nEntities + nEntities);
+	for (int i = 0; i < nEntities; i++)
+	{
+		EXPECT_EQ(entities[i]->health, 105 - i);
+	}
+
+	// the index has to follow the stores around when one is destroyed
+	ctx.getStores().destroyStore(entities[10]);
+	for (int i = 0; i < nEntities; i++)
+	{
+		ctx.getDispatcher().signal(signals::damage{ i, 1 });
+	}
+
+	std::tie(nDispatched, nHandled) = ctx.processSignalsGrouped();
+	EXPECT_EQ(nDispatched, nEntities);
+	EXPECT_EQ(nHandled, nEntities - 1);
+
+	for (int i = 0; i < nEntities; i++)
+	{
+		ctx.getDispatcher().signal(signals::damage{ i, 1 });
+	}
+
+	std::tie(nDispatched, nHandled) = ctx.processSignalsParallel(pool, 8);
+	EXPECT_EQ(nDispatched, nEntities);
+	EXPECT_EQ(nHandled, nEntities - 1);
+
+	// a destroyed store's key is free for a new one
+	auto* recreated = ctx.getStores().createStore<EntityStore>(10);
+	ctx.getDispatcher().signal(signals::damage{ 10, 1 });
+	ctx.getDispatcher().signal(signals::damage{ nEntities - 1, 1 });
+	std::tie(nDispatched, nHandled) = ctx.processSignals();
+	EXPECT_EQ(nHandled, 2);
+	EXPECT_EQ(recreated->health, 99);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
 TEST(flux_tests, todo_adv_test)
 {
 
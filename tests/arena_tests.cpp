@@ -28,6 +28,41 @@ namespace __arena_tests
 			destructorCounter++;
 		}
 	};
+
+	// a distinct destructible type per N, counting destructions per type
+	static int trackedDestroyed[32] = {};
+	template <size_t N>
+	struct tracked
+	{
+		tracked(int) {}
+		~tracked() { trackedDestroyed[N]++; }
+	};
+
+	template <typename allocator_t, size_t ... N>
+	void construct_tracked(allocator_t& allocator, std::index_sequence<N...>)
+	{
+		(allocator.template construct<tracked<N>>("", 0), ...);
+		(allocator.template construct<tracked<N>>("", 0), ...);
+		(allocator.template construct_n<tracked<N>>("", 3, [](size_t i) { return static_cast<int>(i); }), ...);
+	}
+
+	// std::allocator that counts how often it actually goes to the system
+	static int nSystemAllocations = 0;
+	template <typename T>
+	struct counting_allocator : public std::allocator<T>
+	{
+		using value_type = T;
+		template <typename U> struct rebind { using other = counting_allocator<U>; };
+
+		counting_allocator() noexcept = default;
+		template <typename U> counting_allocator(const counting_allocator<U>&) noexcept {}
+
+		T* allocate(size_t n)
+		{
+			nSystemAllocations++;
+			return std::allocator<T>::allocate(n);
+		}
+	};
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -171,6 +206,201 @@ TEST(arena_allocator_tests, saturate_threaded_test)
 
 //////////////////////////////////////////////////////////////////////////
 
+TEST(arena_allocator_tests, construct_n_test)
+{
+	using namespace __arena_tests;
+	using allocator_t = cxpr_flux::arena_allocator<std::allocator<void>, 1024 * 8>;
+	static constexpr size_t nObjects = allocator_t::max_construct_n<destructor_test>();
+
+	destructorCounter = 0;
+	{
+		std::unique_ptr<allocator_t> allocator = std::make_unique<allocator_t>();
+		for (int iter = 0; iter < 4; iter++)
+		{
+			auto created = allocator->construct_n<destructor_test>("", nObjects, [](size_t i) { return static_cast<int>(i); });
+			EXPECT_EQ(created.size(), nObjects);
+			for (size_t i = 0; i < nObjects; i++)
+			{
+				EXPECT_EQ(created[i].i, static_cast<int>(i));
+			}
+
+			auto trivials = allocator->construct_n<double>("", 16, [](size_t i) { return static_cast<double>(i); });
+			EXPECT_DOUBLE_EQ(trivials[15], 15.0);
+		}
+		allocator->purge();
+		EXPECT_EQ(destructorCounter, nObjects * 4);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(arena_allocator_tests, purge_reuse_test)
+{
+	using namespace __arena_tests;
+	using allocator_t = cxpr_flux::arena_allocator<std::allocator<void>, 1024 * 8>;
+	struct alignas(64) aligned_test { char c; };
+
+	destructorCounter = 0;
+	{
+		std::unique_ptr<allocator_t> allocator = std::make_unique<allocator_t>();
+		size_t grownCapacity = 0;
+		for (int iter = 0; iter < 8; iter++)
+		{
+			for (int i = 0; i < 10000; i++)
+			{
+				auto d = allocator->construct<destructor_test>("", i);
+				EXPECT_EQ(d->i, i);
+				auto aligned = allocator->construct<aligned_test>("", aligned_test{ 'a' });
+				EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % alignof(aligned_test), 0);
+			}
+			allocator->purge();
+
+			// the first frame grows the chain, every frame after runs out of the same slabs
+			if (iter == 0)
+			{
+				grownCapacity = allocator->capacity();
+			}
+			EXPECT_EQ(allocator->capacity(), grownCapacity);
+		}
+		EXPECT_EQ(destructorCounter, 10000 * 8);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(arena_allocator_tests, steady_state_test)
+{
+	using namespace __arena_tests;
+	using allocator_t = cxpr_flux::arena_allocator<counting_allocator<void>, 1024 * 8>;
+	static constexpr int nObjects = 100000;
+
+	destructorCounter = 0;
+	nSystemAllocations = 0;
+	{
+		allocator_t allocator;
+		for (int i = 0; i < nObjects; i++)
+		{
+			allocator.construct<destructor_test>("", i);
+		}
+		allocator.purge();
+
+		// slabs grow geometrically, so the first frame only needs a few of them
+		const int nGrowAllocations = nSystemAllocations;
+		EXPECT_LT(nGrowAllocations, 24);
+
+		for (int iter = 0; iter < 4; iter++)
+		{
+			for (int i = 0; i < nObjects; i++)
+			{
+				allocator.construct<destructor_test>("", i);
+			}
+			allocator.purge();
+		}
+		EXPECT_EQ(nSystemAllocations, nGrowAllocations);
+	}
+	EXPECT_EQ(destructorCounter, nObjects * 5);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(arena_allocator_tests, thread_magazines_test)
+{
+	using namespace __arena_tests;
+	using allocator_t = cxpr_flux::arena_allocator<std::allocator<void>, 1024 * 8>;
+	static constexpr int nThreads = 8;
+	static constexpr int nObjects = 2000;
+
+	destructorCounter = 0;
+	allocator_t allocator;
+	std::thread workers[nThreads];
+	for (int thread_idx = 0; thread_idx < nThreads; thread_idx++)
+	{
+		workers[thread_idx] = std::thread([&allocator, thread_idx]
+		{
+			std::vector<destructor_test*> objs;
+			for (int i = 0; i < nObjects; i++)
+			{
+				objs.push_back(allocator.construct<destructor_test>("", thread_idx * nObjects + i));
+			}
+
+			for (int i = 0; i < nObjects; i++)
+			{
+				EXPECT_EQ(objs[i]->i, thread_idx * nObjects + i);
+			}
+		});
+	}
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	// purge retires every thread's magazine, allocating again must start from fresh ones
+	allocator.purge();
+	EXPECT_EQ(destructorCounter, nThreads * nObjects);
+
+	auto first = allocator.construct<double>("", 1.0);
+	auto second = allocator.construct<double>("", 2.0);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(second) - reinterpret_cast<uintptr_t>(first), sizeof(double));
+	EXPECT_DOUBLE_EQ(*first, 1.0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(arena_allocator_tests, typed_destructors_test)
+{
+	using namespace __arena_tests;
+	using allocator_t = cxpr_flux::arena_allocator<std::allocator<void>, 1024 * 8>;
+	static constexpr size_t nTypes = 24;	// more than the arena has buckets for, some take the overflow path
+
+	allocator_t allocator;
+	for (int iter = 0; iter < 2; iter++)
+	{
+		construct_tracked(allocator, std::make_index_sequence<nTypes>{});
+		allocator.construct<std::string>("", "destroyed through its type's list, not a vtable");
+		allocator.purge();
+	}
+
+	for (size_t i = 0; i < nTypes; i++)
+	{
+		EXPECT_EQ(trackedDestroyed[i], 2 * 5);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(arena_allocator_tests, stl_allocator_test)
+{
+	using namespace __arena_tests;
+	using arena_t = cxpr_flux::arena_allocator<counting_allocator<void>, 1024 * 8>;
+	using allocator_t = cxpr_flux::arena_stl_allocator<int, arena_t>;
+
+	arena_t arena;
+	for (int frame = 0; frame < 4; frame++)
+	{
+		if (frame == 1)
+		{
+			nSystemAllocations = 0;
+		}
+
+		{	// rebuilt every frame, only the slabs it grows into come from the system (once)
+			std::vector<int, allocator_t> values{ allocator_t(arena) };
+			std::deque<int, allocator_t> queue{ allocator_t(arena) };
+			for (int i = 0; i < 1000; i++)
+			{
+				values.push_back(i);
+				queue.push_front(i);
+			}
+			EXPECT_EQ(values[999], 999);
+			EXPECT_EQ(queue.front(), 999);
+		}
+		arena.purge();
+	}
+	EXPECT_EQ(nSystemAllocations, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
 TEST(arena_allocator_tests, move_semantics_test)
 {
 	using namespace __arena_tests;
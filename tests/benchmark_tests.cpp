@@ -0,0 +1,379 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <cxpr_flux.h>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+// Micro benchmarks. These only check that both sides of a comparison did the same work,
+// timings are printed rather than asserted so they can't flake on a loaded machine.
+// Disabled so the unit suite stays quick, run them with --gtest_also_run_disabled_tests.
+//////////////////////////////////////////////////////////////////////////
+
+#pragma warning(disable:4307) // integer overflow during hashing
+
+using namespace cxpr;
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace __benchmark_tests
+{
+	template <int N>
+	struct bench_signal
+	{
+		int value = 0;
+	};
+
+	struct BenchStore : public cxpr_flux::flux_store<BenchStore>
+	{
+		using cxpr_flux::flux_store<BenchStore>::flux_store;
+		using state_t = __int64;
+
+		template <int N>
+		static constexpr decltype(auto) make_bench_callback()
+		{
+			return cxpr_flux::make_callback<bench_signal<N>>(
+				[](BenchStore& self, const bench_signal<N>& signal, auto& context)
+				{
+					self.total += signal.value + N;
+				});
+		}
+
+		static constexpr decltype(auto) GetCallbacks()
+		{
+			return std::make_tuple
+			(
+				make_bench_callback<0>(), make_bench_callback<1>(), make_bench_callback<2>(), make_bench_callback<3>(),
+				make_bench_callback<4>(), make_bench_callback<5>(), make_bench_callback<6>(), make_bench_callback<7>(),
+				make_bench_callback<8>(), make_bench_callback<9>(), make_bench_callback<10>(), make_bench_callback<11>(),
+				make_bench_callback<12>(), make_bench_callback<13>(), make_bench_callback<14>(), make_bench_callback<15>()
+			);
+		}
+
+		state_t total = 0;
+	};
+
+	using context_t = cxpr_flux::flux_static_context<std::allocator<void>, BenchStore>;
+	using store_facade_t = context_t::store_facade_t;
+
+	//////////////////////////////////////////////////////////////////////////
+	// The hash-keyed lookup processSignals used before the dense signal index, kept here as
+	// the baseline to compare against
+	template <typename ... messages_t>
+	constexpr decltype(auto) hashed_dispatch_table(cxpr::typeset<messages_t...> token)
+	{
+		using functor_t = int(*)(store_facade_t& ctx, const cxpr_flux::flux_signal& var);
+		return cxpr::make_static_map<cxpr::hash_t, functor_t>(
+			{
+				{
+					cxpr::typehash_v<std::decay_t<messages_t>>,
+					[](store_facade_t& ctx, const cxpr_flux::flux_signal& signal)
+					{
+						using payload_t = std::decay_t<messages_t>;
+						return ctx.dispatchSignal(*static_cast<const payload_t*>(signal.payload()));
+					}
+				}...
+			});
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// flux_callback as it was before the invoke/manage thunks, a bound_lambda with a vtable
+	// placed in the inline buffer. Kept here as the baseline to compare against
+	template <typename signature_t>
+	struct virtual_callback;
+
+	template <typename ret_t, typename ... params_t>
+	struct virtual_callback<ret_t(params_t ...)>
+	{
+		struct impl_t
+		{
+			virtual ~impl_t() = default;
+			virtual ret_t operator()(params_t... p) = 0;
+		};
+
+		template <typename lambda_t>
+		struct bound_t : impl_t
+		{
+			bound_t(lambda_t lam) : lambda(std::move(lam)) {}
+			ret_t operator()(params_t... p) override { return lambda(std::forward<params_t>(p)...); }
+			lambda_t lambda;
+		};
+
+		virtual_callback() = default;
+		virtual_callback(const virtual_callback& other) { *this = other; }
+		virtual_callback& operator=(const virtual_callback& other)
+		{
+			memcpy(inline_mem, other.inline_mem, sizeof(inline_mem));
+			impl = other.impl != nullptr ? reinterpret_cast<impl_t*>(inline_mem) : nullptr;
+			return *this;
+		}
+		~virtual_callback() { if (impl != nullptr) impl->~impl_t(); }
+
+		template <typename lambda_t>
+		void bind_lambda(lambda_t lam)
+		{
+			static_assert(sizeof(bound_t<lambda_t>) <= sizeof(inline_mem));
+			impl = new (inline_mem) bound_t<lambda_t>(std::move(lam));
+		}
+
+		ret_t operator()(params_t... p) const { return (*impl)(std::forward<params_t>(p)...); }
+
+		impl_t* impl = nullptr;
+		alignas(void*) char inline_mem[cxpr_flux::small_callback_size];
+		int sentinel = 1234567;
+	};
+
+	// std::function is assigned a lambda, the flux callbacks bind one
+	template <typename callback_t, typename lambda_t>
+	void bind_callback(callback_t& callback, lambda_t&& lam)
+	{
+		if constexpr (std::is_assignable_v<callback_t&, lambda_t>)
+		{
+			callback = std::forward<lambda_t>(lam);
+		}
+		else
+		{
+			callback.bind_lambda(std::forward<lambda_t>(lam));
+		}
+	}
+
+	// a few different lambdas so nothing can be devirtualized or inlined
+	template <typename callback_t>
+	std::vector<callback_t> make_callbacks(size_t count, __int64& total)
+	{
+		std::vector<callback_t> callbacks(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			switch (i % 4)
+			{
+			case 0: bind_callback(callbacks[i], [&total](int value) { total += value; }); break;
+			case 1: bind_callback(callbacks[i], [&total](int value) { total -= value; }); break;
+			case 2: bind_callback(callbacks[i], [&total](int value) { total ^= value; }); break;
+			default: bind_callback(callbacks[i], [&total, i](int value) { total += value * static_cast<__int64>(i & 7); }); break;
+			}
+		}
+		return callbacks;
+	}
+
+	template <typename func_t>
+	double time_ms(func_t&& functor)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		functor();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	template <size_t ... N>
+	void signal_all(context_t& ctx, int count, std::index_sequence<N...>)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			(ctx.getDispatcher().signal(bench_signal<N>{ i }), ...);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_benchmarks, DISABLED_dense_vs_hashed_dispatch_table)
+{
+	using namespace __benchmark_tests;
+	static constexpr int nRounds = 20000;	// x16 signal types
+	static constexpr int nPasses = 5;
+
+	context_t ctx;
+	BenchStore* store = ctx.getStores().createStore<BenchStore>();
+
+	signal_all(ctx, nRounds, std::make_index_sequence<16>{});
+
+	constexpr auto denseTable = cxpr_flux::__detail::generate_dispatch_table<store_facade_t, BenchStore>();
+	constexpr cxpr_flux::__detail::payloads_t<BenchStore> token = {};
+	constexpr auto hashedTable = hashed_dispatch_table(token);
+
+	// time both lookups over the same drained list, straight out of the dispatcher's arena
+	ctx.getDispatcher().processSignalList([&](const cxpr_flux::flux_signal_node* signals)
+	{
+		int nDense = 0;
+		const double denseMs = time_ms([&]
+		{
+			for (int pass = 0; pass < nPasses; pass++)
+			{
+				for (auto signal = signals; signal != nullptr; signal = signal->next.load(std::memory_order_relaxed))
+				{
+					nDense += denseTable[signal->index()](ctx.getStores(), *signal);
+				}
+			}
+		});
+		const auto denseTotal = store->total;
+
+		store->total = 0;
+		int nHashed = 0;
+		const double hashedMs = time_ms([&]
+		{
+			for (int pass = 0; pass < nPasses; pass++)
+			{
+				for (auto signal = signals; signal != nullptr; signal = signal->next.load(std::memory_order_relaxed))
+				{
+					auto [found, entry] = hashedTable.get_entry(signal->hash());
+					if (found)
+					{
+						nHashed += std::invoke(*entry, ctx.getStores(), *signal);
+					}
+				}
+			}
+		});
+
+		EXPECT_EQ(nDense, nHashed);
+		EXPECT_EQ(nDense, nRounds * 16 * nPasses);
+		EXPECT_EQ(store->total, denseTotal);
+
+		std::cout << "[ bench    ] " << nRounds * 16 * nPasses << " signals, dense index table: " << denseMs
+			<< "ms, hashed map: " << hashedMs << "ms (" << (hashedMs / denseMs) << "x)" << std::endl;
+
+		return std::make_pair(nRounds * 16, nDense);
+	});
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_benchmarks, DISABLED_arena_allocation_scaling)
+{
+	using namespace __benchmark_tests;
+	using arena_t = cxpr_flux::arena_allocator<std::allocator<void>, 1024 * 32>;
+	static constexpr int nAllocations = 1 << 20;	// split over however many threads
+
+	arena_t arena;
+	double singleMs = 0.0;
+	for (int nThreads : { 1, 4, 16 })
+	{
+		// first frame grows the slab chain, time the second one
+		double frameMs = 0.0;
+		for (int frame = 0; frame < 2; frame++)
+		{
+			std::atomic_int nAllocated{ 0 };
+			std::vector<std::thread> threads;
+			frameMs = time_ms([&]
+			{
+				for (int thread_idx = 0; thread_idx < nThreads; thread_idx++)
+				{
+					threads.emplace_back([&arena, &nAllocated, nThreads]
+					{
+						for (int i = 0; i < nAllocations / nThreads; i++)
+						{
+							arena.construct<double>("", static_cast<double>(i));
+						}
+						nAllocated += nAllocations / nThreads;
+					});
+				}
+
+				for (auto& thread : threads)
+				{
+					thread.join();
+				}
+			});
+
+			EXPECT_EQ(nAllocated, nAllocations);
+			arena.purge();
+		}
+
+		if (nThreads == 1)
+		{
+			singleMs = frameMs;
+		}
+
+		std::cout << "[ bench    ] " << nAllocations << " arena allocations on " << nThreads << " threads: " 
+			<< frameMs << "ms (" << (singleMs / frameMs) << "x single thread)" << std::endl;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_benchmarks, DISABLED_persistent_vs_copied_snapshots)
+{
+	using namespace __benchmark_tests;
+	static constexpr int nEntries = 1 << 20;
+	static constexpr int nFrames = 20;
+	static constexpr int nChangesPerFrame = 100;
+
+	// a frame changes a handful of entries, then publishes a snapshot to a container
+	std::vector<__int64> copied(nEntries);
+	cxpr_flux::persistent_map<int, __int64> persistent;
+	for (int i = 0; i < nEntries; i++)
+	{
+		persistent.set(i, 0);
+	}
+
+	__int64 copiedTotal = 0;
+	const double copiedMs = time_ms([&]
+	{
+		for (int frame = 0; frame < nFrames; frame++)
+		{
+			for (int i = 0; i < nChangesPerFrame; i++)
+			{
+				copied[(frame * 7919 + i * 104729) % nEntries] += i;
+			}
+			const std::vector<__int64> snapshot = copied;
+			copiedTotal += snapshot[frame];
+		}
+	});
+
+	__int64 persistentTotal = 0;
+	const double persistentMs = time_ms([&]
+	{
+		for (int frame = 0; frame < nFrames; frame++)
+		{
+			for (int i = 0; i < nChangesPerFrame; i++)
+			{
+				persistent.update((frame * 7919 + i * 104729) % nEntries, [i](__int64& value) { value += i; });
+			}
+			const auto snapshot = persistent;
+			persistentTotal += snapshot.at(frame);
+		}
+	});
+
+	EXPECT_EQ(copiedTotal, persistentTotal);
+	std::cout << "[ bench    ] " << nFrames << " frames over " << nEntries << " entries, copied vector snapshots: " << copiedMs
+		<< "ms, persistent map: " << persistentMs << "ms (" << (copiedMs / persistentMs) << "x)" << std::endl;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_benchmarks, DISABLED_callback_invocation)
+{
+	using namespace __benchmark_tests;
+	using signature_t = void(int);
+	static constexpr size_t nCallbacks = 1024;
+	static constexpr int nPasses = 2000;
+
+	auto time_calls = [&](auto& callbacks)
+	{
+		return time_ms([&]
+		{
+			for (int pass = 0; pass < nPasses; pass++)
+			{
+				for (const auto& callback : callbacks)
+				{
+					callback(pass);
+				}
+			}
+		});
+	};
+
+	__int64 fluxTotal = 0, virtualTotal = 0, stdTotal = 0;
+	auto fluxCallbacks = make_callbacks<cxpr_flux::flux_callback<signature_t>>(nCallbacks, fluxTotal);
+	auto virtualCallbacks = make_callbacks<virtual_callback<signature_t>>(nCallbacks, virtualTotal);
+	auto stdCallbacks = make_callbacks<std::function<signature_t>>(nCallbacks, stdTotal);
+
+	const double fluxMs = time_calls(fluxCallbacks);
+	const double virtualMs = time_calls(virtualCallbacks);
+	const double stdMs = time_calls(stdCallbacks);
+
+	EXPECT_EQ(fluxTotal, virtualTotal);
+	EXPECT_EQ(fluxTotal, stdTotal);
+	std::cout << "[ bench    ] " << nCallbacks * nPasses << " calls, flux_callback (" << sizeof(cxpr_flux::flux_callback<signature_t>) << "b): " << fluxMs
+		<< "ms, vtable callback (" << sizeof(virtual_callback<signature_t>) << "b): " << virtualMs
+		<< "ms, std::function (" << sizeof(std::function<signature_t>) << "b): " << stdMs << "ms" << std::endl;
+}
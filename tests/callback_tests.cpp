@@ -0,0 +1,139 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <cxpr_flux.h>
+
+//////////////////////////////////////////////////////////////////////////
+
+using namespace cxpr;
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_callback_tests, handle_removal)
+{
+	cxpr_flux::callback_list<void(std::vector<int>&)> list;
+	std::vector<cxpr_flux::flux_callback_handle> handles;
+	for (int i = 0; i < 1000; i++)
+	{
+		handles.push_back(list.registerCallback(nullptr, [i](std::vector<int>& called) { called.push_back(i); }));
+	}
+	EXPECT_EQ(list.size(), 1000);
+
+	// drop every odd one, the rest keep their order
+	for (int i = 1; i < 1000; i += 2)
+	{
+		EXPECT_TRUE(list.removeCallback(handles[i]));
+	}
+	EXPECT_FALSE(list.removeCallback(handles[1]));
+	EXPECT_EQ(list.size(), 500);
+
+	std::vector<int> called;
+	list.call(called);
+	ASSERT_EQ(called.size(), 500);
+	for (int i = 0; i < 500; i++)
+	{
+		EXPECT_EQ(called[i], i * 2);
+	}
+
+	// reused slots don't revive stale handles
+	auto reused = list.registerCallback(nullptr, [](std::vector<int>& called) { called.push_back(-1); });
+	EXPECT_FALSE(list.removeCallback(handles[3]));
+	EXPECT_TRUE(list.removeCallback(reused));
+	EXPECT_FALSE(list.removeCallback(cxpr_flux::flux_callback_handle{}));
+
+	// unknown owners are a no-op, known ones lose every callback they registered
+	int owner = 0;
+	list.registerCallback(&owner, [](std::vector<int>& called) { called.push_back(-2); });
+	list.registerCallback(&owner, [](std::vector<int>& called) { called.push_back(-3); });
+	list.clearCallback(&called);
+	EXPECT_EQ(list.size(), 502);
+	list.clearCallback(&owner);
+	EXPECT_EQ(list.size(), 500);
+	called.clear();
+	list.call(called);
+	EXPECT_EQ(called.size(), 500);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_callback_tests, changes_during_call)
+{
+	using list_t = cxpr_flux::big_callback_list<void(int&)>;
+	list_t list;
+	cxpr_flux::flux_callback_handle self, victim;
+	auto capture = std::make_shared<int>(0);
+	std::weak_ptr<int> captured = capture;
+
+	// removes itself and a later callback, and adds a new one, all mid-call
+	self = list.registerCallback(nullptr, [&list, &self, &victim, &captured, capture](int& called)
+	{
+		called += 1;
+		list.removeCallback(self);
+		list.removeCallback(victim);
+		list.registerCallback(nullptr, [](int& called) { called += 100; });
+		EXPECT_FALSE(captured.expired()); // not destroyed while it runs
+	});
+	victim = list.registerCallback(nullptr, [](int& called) { called += 10; });
+	list.registerCallback(nullptr, [](int& called) { called += 1000; });
+	capture.reset();
+
+	int called = 0;
+	list.call(called);
+	EXPECT_EQ(called, 1001);	// victim skipped, the new one waits for the next call
+	EXPECT_EQ(list.size(), 2);
+	EXPECT_TRUE(captured.expired());
+
+	called = 0;
+	list.call(called);
+	EXPECT_EQ(called, 1100);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_callback_tests, thunk_semantics)
+{
+	// two thunk pointers + the lambda, the vptr used to live in the buffer
+	static_assert(sizeof(cxpr_flux::flux_callback<void()>) == 32);
+	static_assert(sizeof(cxpr_flux::flux_big_callback<void()>) == 112);
+
+	auto capture = std::make_shared<int>(41);
+	{
+		cxpr_flux::flux_callback<int(int)> callback;
+		EXPECT_FALSE(callback);
+		EXPECT_FALSE(callback(1).has_value());
+
+		// non-trivial captures are copied, moved and destroyed through the manager
+		callback.bind_lambda([capture](int add) { return *capture + add; });
+		EXPECT_EQ(capture.use_count(), 2);
+		auto copied = callback;
+		EXPECT_EQ(capture.use_count(), 3);
+		auto moved = std::move(copied);
+		EXPECT_FALSE(copied);
+		EXPECT_EQ(capture.use_count(), 3);
+		EXPECT_EQ(*moved(1), 42);
+
+		// rebinding or overwriting lets go of the old lambda
+		moved.bind_lambda([](int add) { return add; });
+		EXPECT_EQ(capture.use_count(), 2);
+		EXPECT_EQ(*moved(1), 1);
+		callback = moved;
+		EXPECT_EQ(capture.use_count(), 1);
+		EXPECT_EQ(*callback(5), 5);
+
+		// move-only captures can be bound and moved
+		cxpr_flux::flux_callback<int()> owning;
+		owning.bind_lambda([value = std::make_unique<int>(7)] { return *value; });
+		auto owner = std::move(owning);
+		EXPECT_EQ(*owner(), 7);
+
+		// but not copied: that fails the precondition, without checks the copy comes out empty
+		// and the original keeps working
+		cxpr_flux::flux_callback<int()> ownerCopy;
+		EXPECT_DEBUG_DEATH(ownerCopy = owner, "move-only");
+		EXPECT_FALSE(ownerCopy);
+		EXPECT_FALSE(ownerCopy().has_value());
+		EXPECT_EQ(*owner(), 7);
+	}
+	EXPECT_EQ(capture.use_count(), 1);
+}
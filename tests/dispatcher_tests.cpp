@@ -0,0 +1,567 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <cxpr_flux.h>
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+
+using namespace cxpr;
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace __dispatcher_tests
+{
+	struct producer_signal
+	{
+		int producer = 0;
+		int sequence = 0;
+	};
+
+	// payload with a dynamic member that follows the signal into the arena
+	struct note_signal
+	{
+		using allocator_type = cxpr_flux::flux_payload_allocator;
+
+		note_signal(const char* _text, const allocator_type& alloc = {}) : text(_text, alloc) {}
+		note_signal(const note_signal& other, const allocator_type& alloc = {}) : text(other.text, alloc) {}
+		note_signal(note_signal&& other, const allocator_type& alloc = {}) : text(std::move(other.text), alloc) {}
+
+		cxpr_flux::flux_string text;
+	};
+
+	struct bulk_signal
+	{
+		static constexpr cxpr_flux::flux_priority priority = cxpr_flux::flux_priority::low;
+		int sequence = 0;
+	};
+
+	// priority fields that aren't a static flux_priority are just data
+	struct task_signal
+	{
+		int priority;
+	};
+
+	struct job_signal
+	{
+		cxpr_flux::flux_priority priority;
+	};
+
+	// doesn't fit in a small dispatcher's slab
+	struct oversized_signal
+	{
+		int sequence = 0;
+		char data[2048] = {};
+	};
+
+	// counts live payloads, to see when their arena gets purged
+	struct tracked_signal
+	{
+		tracked_signal(std::atomic_int& _live) : live(&_live) { (*live)++; }
+		tracked_signal(const tracked_signal& other) : live(other.live) { (*live)++; }
+		~tracked_signal() { (*live)--; }
+
+		std::atomic_int* live;
+	};
+
+	using dispatcher_t = cxpr_flux::flux_dispatcher<std::allocator<void>>;
+
+	void run_concurrent_producers(const cxpr_flux::flux_dispatcher_options& options)
+	{
+		static constexpr int nProducers = 8;
+		static constexpr int nSignals = 20000;
+
+		dispatcher_t dispatcher(std::allocator<void>{}, options);
+		std::atomic_int finished{ 0 };
+		std::thread producers[nProducers];
+		for (int producer = 0; producer < nProducers; producer++)
+		{
+			producers[producer] = std::thread([&dispatcher, &finished, producer]
+			{
+				// spread over the lanes, each producer sticks to one so its signals stay in order
+				const auto priority = static_cast<cxpr_flux::flux_priority>(producer % cxpr_flux::flux_priority_count);
+				for (int i = 0; i < nSignals; i++)
+				{
+					dispatcher.signal(priority, producer_signal{ producer, i });
+				}
+				finished++;
+			});
+		}
+
+		// drain while the producers are still running, every signal must show up exactly once
+		// and in order relative to the other signals from the same producer
+		int expected[nProducers] = {};
+		int nReceived = 0;
+		auto drain = [&]
+		{
+			return dispatcher.processSignals([&](const auto& signal)
+			{
+				const auto& payload = *static_cast<const producer_signal*>(signal.payload());
+				EXPECT_EQ(payload.sequence, expected[payload.producer]);
+				expected[payload.producer] = payload.sequence + 1;
+				nReceived++;
+				return 1;
+			});
+		};
+
+		while (finished < nProducers)
+		{
+			drain();
+		}
+		// budgeted lanes may take a few more passes
+		while (drain().first > 0) {}
+
+		for (auto& p : producers)
+		{
+			p.join();
+		}
+
+		EXPECT_EQ(nReceived, nProducers * nSignals);
+		for (int producer = 0; producer < nProducers; producer++)
+		{
+			EXPECT_EQ(expected[producer], nSignals);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_dispatcher_tests, concurrent_producers_test)
+{
+	__dispatcher_tests::run_concurrent_producers({});
+}
+
+TEST(flux_dispatcher_tests, per_thread_arenas_test)
+{
+	cxpr_flux::flux_dispatcher_options options = {};
+	options.perThreadArenas = true;
+	__dispatcher_tests::run_concurrent_producers(options);
+}
+
+TEST(flux_dispatcher_tests, ring_buffers_test)
+{
+	cxpr_flux::flux_dispatcher_options options = {};
+	options.nBuffers = 3;
+	options.purgeMode = cxpr_flux::flux_purge_mode::deferred;
+	__dispatcher_tests::run_concurrent_producers(options);
+
+	cxpr_flux::flux_thread_pool pool(2);
+	options.nBuffers = 4;
+	options.purgeMode = cxpr_flux::flux_purge_mode::background;
+	options.purgePool = &pool;
+	options.perThreadArenas = true;
+	__dispatcher_tests::run_concurrent_producers(options);
+}
+
+TEST(flux_dispatcher_tests, lane_budgets_test)
+{
+	cxpr_flux::flux_dispatcher_options options = {};
+	options.nBuffers = 3;
+	options.laneBudgets[static_cast<size_t>(cxpr_flux::flux_priority::normal)] = 1000;
+	options.laneBudgets[static_cast<size_t>(cxpr_flux::flux_priority::low)] = 10;
+	options.purgeMode = cxpr_flux::flux_purge_mode::deferred;
+	__dispatcher_tests::run_concurrent_producers(options);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_dispatcher_tests, priority_lanes_test)
+{
+	using namespace __dispatcher_tests;
+	static constexpr int nBulk = 1000;
+	static constexpr int nBudget = 100;
+	static_assert(cxpr_flux::flux_signal_priority_v<bulk_signal> == cxpr_flux::flux_priority::low);
+	static_assert(cxpr_flux::flux_signal_priority_v<producer_signal> == cxpr_flux::flux_priority::normal);
+	static_assert(cxpr_flux::flux_signal_priority_v<task_signal> == cxpr_flux::flux_priority::normal);
+	static_assert(cxpr_flux::flux_signal_priority_v<job_signal> == cxpr_flux::flux_priority::normal);
+
+	cxpr_flux::flux_dispatcher_options options = {};
+	options.laneBudgets[static_cast<size_t>(cxpr_flux::flux_priority::low)] = nBudget;
+	for (size_t maxBuffers : { options.maxBuffers, options.nBuffers })
+	{
+		options.maxBuffers = maxBuffers;
+		dispatcher_t dispatcher(std::allocator<void>{}, options);
+
+		// a bulk flood, then a couple of signals that shouldn't wait for it
+		std::atomic_int live{ 0 };
+		dispatcher.signal(cxpr_flux::flux_priority::low, tracked_signal(live));
+		dispatcher.signal_batch<bulk_signal>(nBulk, [](size_t i) { return bulk_signal{ static_cast<int>(i) }; });
+		dispatcher.signal(producer_signal{ 0, 0 });
+		dispatcher.signal(cxpr_flux::flux_priority::high, producer_signal{ 1, 0 });
+
+		int nextBulk = 0;
+		std::vector<int> producers;
+		auto pass = [&]
+		{
+			int nBulkInPass = 0;
+			producers.clear();
+			return dispatcher.processSignals([&](const auto& signal)
+			{
+				if (signal.hash() == cxpr::typehash_v<producer_signal>)
+				{
+					producers.push_back(static_cast<const producer_signal*>(signal.payload())->producer);
+					if (maxBuffers != options.nBuffers)
+					{
+						EXPECT_EQ(nBulkInPass, 0);	// ahead of the bulk
+					}
+				}
+				else if (signal.hash() == cxpr::typehash_v<bulk_signal>)
+				{
+					EXPECT_EQ(static_cast<const bulk_signal*>(signal.payload())->sequence, nextBulk++);
+					nBulkInPass++;
+				}
+				return 1;
+			}).first;
+		};
+
+		// highest lane first, the low lane only gets its budget (tracked_signal + 99 bulk)
+		EXPECT_EQ(pass(), 2 + nBudget);
+		EXPECT_EQ(producers, (std::vector<int>{ 1, 0 }));
+		EXPECT_EQ(nextBulk, nBudget - 1);
+
+		dispatcher.signal(cxpr_flux::flux_priority::high, producer_signal{ 2, 0 });
+		if (maxBuffers == options.nBuffers)
+		{
+			// no spare to move on to, the backlog's buffer is needed again so everything
+			// left in it goes out first
+			EXPECT_EQ(pass(), nBulk + 1 - nBudget + 1);
+			EXPECT_EQ(producers, (std::vector<int>{ 2 }));
+		}
+		else
+		{
+			// new high priority signals still jump the backlog, which holds on to its buffer
+			EXPECT_EQ(pass(), 1 + nBudget);
+			EXPECT_EQ(producers, (std::vector<int>{ 2 }));
+			EXPECT_EQ(live, 1);
+
+			int nPasses = 0;
+			while (pass() > 0)
+			{
+				nPasses++;
+			}
+			EXPECT_EQ(nPasses, (nBulk + 1 + nBudget - 1) / nBudget - 2);
+		}
+		EXPECT_EQ(nextBulk, nBulk);
+		EXPECT_EQ(live, 0);
+		EXPECT_EQ(pass(), 0);
+	}
+}
+
+TEST(flux_dispatcher_tests, priority_fields_test)
+{
+	using namespace __dispatcher_tests;
+	dispatcher_t dispatcher(std::allocator<void>{});
+
+	// payloads carrying their own priority field still compile and go in the normal lane
+	dispatcher.signal(bulk_signal{ 0 });
+	dispatcher.signal(task_signal{ 7 });
+	dispatcher.signal(job_signal{ cxpr_flux::flux_priority::low });
+	dispatcher.signal(cxpr_flux::flux_priority::high, producer_signal{ 0, 0 });
+
+	std::vector<cxpr::hash_t> order;
+	dispatcher.processSignals([&](const auto& signal)
+	{
+		order.push_back(signal.hash());
+		if (signal.hash() == cxpr::typehash_v<task_signal>)
+		{
+			EXPECT_EQ(static_cast<const task_signal*>(signal.payload())->priority, 7);
+		}
+		return 1;
+	});
+	EXPECT_EQ(order, (std::vector<cxpr::hash_t>{ cxpr::typehash_v<producer_signal>, cxpr::typehash_v<task_signal>, 
+		cxpr::typehash_v<job_signal>, cxpr::typehash_v<bulk_signal> }));
+}
+
+TEST(flux_dispatcher_tests, budgeted_backlog_test)
+{
+	using namespace __dispatcher_tests;
+	static constexpr int nSignals = 10000;
+	static constexpr size_t nBudget = 1000;
+
+	cxpr_flux::flux_dispatcher_options options = {};
+	options.nBuffers = 2;
+	dispatcher_t dispatcher(std::allocator<void>{}, options);
+	dispatcher.signal_batch<producer_signal>(nSignals, [](size_t i) { return producer_signal{ 0, static_cast<int>(i) }; });
+
+	int nextSequence = 0;
+	int nHigh = 0;
+	auto pass = [&]
+	{
+		cxpr_flux::flux_dispatch_budget budget = {};
+		budget.maxSignals = nBudget;
+		bool first = true;
+		return dispatcher.processSignals([&](const auto& signal)
+		{
+			const auto* payload = static_cast<const producer_signal*>(signal.payload());
+			if (payload->producer == 1)
+			{
+				EXPECT_TRUE(first);	// ahead of the backlog
+				nHigh++;
+			}
+			else
+			{
+				EXPECT_EQ(payload->sequence, nextSequence++);
+			}
+			first = false;
+			return 1;
+		}, budget);
+	};
+
+	auto result = pass();
+	EXPECT_EQ(result.nDispatched, static_cast<int>(nBudget));
+	EXPECT_EQ(result.nRemaining, nSignals - nBudget);
+
+	// every pass leaves a backlog holding a buffer, high priority signals (and normal ones
+	// queued behind the backlog) are still taken in on the very next call
+	for (int i = 1; i <= 5; i++)
+	{
+		dispatcher.signal(cxpr_flux::flux_priority::high, producer_signal{ 1, i });
+		dispatcher.signal(producer_signal{ 0, nSignals + i - 1 });
+		result = pass();
+		EXPECT_EQ(nHigh, i);
+		EXPECT_EQ(result.nDispatched, static_cast<int>(nBudget));	// the high one counts too
+		EXPECT_EQ(result.nRemaining, nSignals + 2 * i - nBudget * (i + 1));
+	}
+
+	while (pass().nDispatched > 0)
+	{
+	}
+	EXPECT_EQ(nextSequence, nSignals + 5);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_dispatcher_tests, purge_modes_test)
+{
+	using namespace __dispatcher_tests;
+	// small slabs so the signals chain a few of them
+	using small_dispatcher_t = cxpr_flux::flux_dispatcher<std::allocator<void>, cxpr_flux::flux_signal_index<>, 1024>;
+	static constexpr int nSignals = 500;
+
+	cxpr_flux::flux_thread_pool pool(1);
+	for (auto mode : { cxpr_flux::flux_purge_mode::immediate, cxpr_flux::flux_purge_mode::deferred, cxpr_flux::flux_purge_mode::background })
+	{
+		cxpr_flux::flux_dispatcher_options options = {};
+		options.nBuffers = 3;
+		options.purgeMode = mode;
+		options.purgePool = &pool;
+
+		std::atomic_int live{ 0 };
+		{
+			small_dispatcher_t dispatcher(std::allocator<void>{}, options);
+			auto pass = [&](int nExpected)
+			{
+				auto [nDispatched, nHandled] = dispatcher.processSignals([](const auto&) { return 1; });
+				EXPECT_EQ(nDispatched, nExpected);
+			};
+
+			for (int i = 0; i < nSignals; i++)
+			{
+				dispatcher.signal(tracked_signal(live));
+			}
+			pass(nSignals);
+			if (mode == cxpr_flux::flux_purge_mode::immediate)
+			{
+				EXPECT_EQ(live, 0);
+			}
+			else if (mode == cxpr_flux::flux_purge_mode::deferred)
+			{
+				EXPECT_EQ(live, nSignals);
+			}
+
+			// the ring is back at the first buffer, which is reclaimed before it's reused
+			pass(0);
+			pass(0);
+			EXPECT_EQ(live, 0);
+
+			// whatever is still waiting for a purge goes with the dispatcher
+			for (int i = 0; i < nSignals; i++)
+			{
+				dispatcher.signal(tracked_signal(live));
+			}
+			pass(nSignals);
+		}
+		EXPECT_EQ(live, 0);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_dispatcher_tests, signal_during_dispatch_test)
+{
+	using namespace __dispatcher_tests;
+	dispatcher_t dispatcher(std::allocator<void>{});
+
+	dispatcher.signal(producer_signal{ 0, 0 });
+
+	// signals raised while dispatching land in the next pass instead of deadlocking
+	auto [nDispatched, nHandled] = dispatcher.processSignals([&](const auto& signal)
+	{
+		const auto& payload = *static_cast<const producer_signal*>(signal.payload());
+		dispatcher.signal(producer_signal{ 0, payload.sequence + 1 });
+		return 1;
+	});
+	EXPECT_EQ(nDispatched, 1);
+
+	int lastSequence = -1;
+	std::tie(nDispatched, nHandled) = dispatcher.processSignals([&](const auto& signal)
+	{
+		lastSequence = static_cast<const producer_signal*>(signal.payload())->sequence;
+		return 1;
+	});
+	EXPECT_EQ(nDispatched, 1);
+	EXPECT_EQ(lastSequence, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_dispatcher_tests, producers_during_dispatch_test)
+{
+	using namespace __dispatcher_tests;
+	static constexpr int nDuringDispatch = 20000;
+	dispatcher_t dispatcher(std::allocator<void>{});
+
+	dispatcher.signal(producer_signal{ 0, -1 });
+
+	// a producer keeps signalling the whole time, the first pass stalls until it has gotten
+	// nDuringDispatch signals in, which would never happen if the drain held producers off
+	std::atomic_int nProduced{ 0 };
+	std::atomic_bool stop{ false };
+	std::thread producer([&]
+	{
+		for (int i = 0; !stop; i++)
+		{
+			dispatcher.signal(producer_signal{ 1, i });
+			nProduced++;
+		}
+	});
+
+	int expected = 0;
+	auto [nDispatched, nHandled] = dispatcher.processSignals([&](const auto& signal)
+	{
+		const auto& payload = *static_cast<const producer_signal*>(signal.payload());
+		if (payload.producer == 0)
+		{
+			const int started = nProduced;
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+			while (nProduced - started < nDuringDispatch && std::chrono::steady_clock::now() < deadline)
+			{
+				std::this_thread::yield();
+			}
+			EXPECT_GE(nProduced - started, nDuringDispatch);
+		}
+		else
+		{
+			EXPECT_EQ(payload.sequence, expected++);
+		}
+		return 1;
+	});
+	stop = true;
+	producer.join();
+
+	// everything signalled during the stall (and after) arrives in order in the next pass
+	const int nStalled = nProduced - expected;
+	std::tie(nDispatched, nHandled) = dispatcher.processSignals([&](const auto& signal)
+	{
+		EXPECT_EQ(static_cast<const producer_signal*>(signal.payload())->sequence, expected++);
+		return 1;
+	});
+	EXPECT_EQ(nDispatched, nStalled);
+	EXPECT_GE(nDispatched, nDuringDispatch);
+	EXPECT_EQ(expected, nProduced);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_dispatcher_tests, signal_batch_test)
+{
+	using namespace __dispatcher_tests;
+	static constexpr int nSignals = 10000;	// more than fits in one arena slab
+	dispatcher_t dispatcher(std::allocator<void>{});
+
+	dispatcher.signal(producer_signal{ 0, -1 });
+	dispatcher.signal_batch<producer_signal>(nSignals, [](size_t i)
+	{
+		return producer_signal{ 0, static_cast<int>(i) };
+	});
+
+	std::vector<std::string> texts;
+	for (int i = 0; i < 1000; i++)
+	{
+		texts.emplace_back(std::string("batched signal with a heap allocated string ") + std::to_string(i));
+	}
+	dispatcher.signal_range(texts.begin(), texts.end());
+
+	int expected = -1;
+	int nStrings = 0;
+	auto [nDispatched, nHandled] = dispatcher.processSignals([&](const auto& signal)
+	{
+		if (signal.hash() == cxpr::typehash_v<producer_signal>)
+		{
+			EXPECT_EQ(static_cast<const producer_signal*>(signal.payload())->sequence, expected);
+			expected++;
+		}
+		else
+		{
+			EXPECT_EQ(*static_cast<const std::string*>(signal.payload()), texts[nStrings]);
+			nStrings++;
+		}
+		return 1;
+	});
+
+	EXPECT_EQ(nDispatched, nSignals + 1 + 1000);
+	EXPECT_EQ(expected, nSignals);
+	EXPECT_EQ(nStrings, 1000);
+
+	// payloads bigger than a slab can't share a run, they're batched one allocation each
+	using small_dispatcher_t = cxpr_flux::flux_dispatcher<std::allocator<void>, cxpr_flux::flux_signal_index<>, 1024>;
+	static_assert(small_dispatcher_t::arena_t::max_construct_n<small_dispatcher_t::signal_impl_t<oversized_signal>>() == 0);
+	small_dispatcher_t smallDispatcher(std::allocator<void>{});
+	smallDispatcher.signal(oversized_signal{ -1 });
+	smallDispatcher.signal_batch<oversized_signal>(10, [](size_t i) { return oversized_signal{ static_cast<int>(i) }; });
+
+	expected = -1;
+	std::tie(nDispatched, nHandled) = smallDispatcher.processSignals([&](const auto& signal)
+	{
+		EXPECT_EQ(static_cast<const oversized_signal*>(signal.payload())->sequence, expected);
+		expected++;
+		return 1;
+	});
+	EXPECT_EQ(nDispatched, 11);
+	EXPECT_EQ(expected, 10);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_dispatcher_tests, arena_payload_test)
+{
+	using namespace __dispatcher_tests;
+	dispatcher_t dispatcher(std::allocator<void>{});
+
+	const std::string longText(200, 'x');		// well past any small string buffer
+	const std::string hugeText(100000, 'y');	// bigger than a whole arena slab
+	dispatcher.emplace<note_signal>(longText.c_str());
+	dispatcher.signal(note_signal(hugeText.c_str()));
+	dispatcher.signal(producer_signal{ 0, 0 });
+
+	int nNotes = 0;
+	auto [nDispatched, nHandled] = dispatcher.processSignals([&](const auto& signal)
+	{
+		if (signal.hash() != cxpr::typehash_v<note_signal>)
+		{
+			return 0;
+		}
+
+		// the text was built in (or moved into) the signal arena rather than the default resource
+		const auto& note = *static_cast<const note_signal*>(signal.payload());
+		EXPECT_NE(note.text.get_allocator().resource(), std::pmr::get_default_resource());
+		EXPECT_NE(dynamic_cast<dispatcher_t::resource_t*>(note.text.get_allocator().resource()), nullptr);
+		EXPECT_EQ(std::string_view(note.text), nNotes == 0 ? longText : hugeText);
+		nNotes++;
+		return 1;
+	});
+
+	EXPECT_EQ(nDispatched, 3);
+	EXPECT_EQ(nHandled, 2);
+}
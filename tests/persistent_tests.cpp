@@ -0,0 +1,274 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <cxpr_flux.h>
+#include <map>
+#include <random>
+
+//////////////////////////////////////////////////////////////////////////
+
+using namespace cxpr;
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace __persistent_tests
+{
+	template <typename map_t, typename reference_t>
+	void expect_same(const map_t& map, const reference_t& reference)
+	{
+		ASSERT_EQ(map.size(), reference.size());
+		auto expected = reference.begin();
+		for (auto it = map.begin(); it != map.end(); ++it, ++expected)
+		{
+			ASSERT_EQ(it.key(), expected->first);
+			ASSERT_EQ(*it, expected->second);
+		}
+		EXPECT_TRUE(expected == reference.end());
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_persistent_tests, map_basics)
+{
+	cxpr_flux::persistent_map<int, std::string> map;
+	EXPECT_TRUE(map.empty());
+	EXPECT_TRUE(map.begin() == map.end());
+	EXPECT_EQ(map.find(0), nullptr);
+
+	EXPECT_TRUE(map.set(5, "five"));
+	EXPECT_TRUE(map.set(1000000, "million"));
+	EXPECT_TRUE(map.set(31, "thirty one"));
+	EXPECT_FALSE(map.set(5, "FIVE"));
+	EXPECT_EQ(map.size(), 3);
+	EXPECT_EQ(map.at(5), "FIVE");
+	EXPECT_EQ(*map.find(1000000), "million");
+	EXPECT_FALSE(map.contains(32));
+	EXPECT_THROW(map.at(6), std::out_of_range);
+
+	EXPECT_TRUE(map.update(31, [](std::string& value) { value += "!"; }));
+	EXPECT_FALSE(map.update(30, [](std::string& value) { value += "!"; }));
+	EXPECT_EQ(map.at(31), "thirty one!");
+
+	{	// ids come out in order
+		std::vector<int> keys;
+		for (auto it = map.begin(); it != map.end(); ++it)
+		{
+			keys.push_back(it.key());
+		}
+		EXPECT_EQ(keys, (std::vector<int>{ 5, 31, 1000000 }));
+	}
+
+	EXPECT_TRUE(map.erase(1000000));
+	EXPECT_FALSE(map.erase(1000000));
+	EXPECT_EQ(map.size(), 2);
+	EXPECT_EQ(map.at(5), "FIVE");
+	EXPECT_TRUE(map.erase(5));
+	EXPECT_TRUE(map.erase(31));
+	EXPECT_TRUE(map.empty());
+	EXPECT_TRUE(map.begin() == map.end());
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_persistent_tests, structural_sharing)
+{
+	static constexpr int nEntries = 100000;
+
+	cxpr_flux::persistent_map<int, int> map;
+	for (int i = 0; i < nEntries; i++)
+	{
+		map.set(i, i);
+	}
+
+	// copies share everything until one of them changes
+	auto snapshot = map;
+	EXPECT_TRUE(snapshot.shares(map));
+	map.set(7, -7);
+	map.erase(nEntries - 1);
+	map.update(nEntries / 2, [](int& value) { value = 0; });
+	EXPECT_FALSE(snapshot.shares(map));
+
+	EXPECT_EQ(snapshot.size(), nEntries);
+	EXPECT_EQ(map.size(), nEntries - 1);
+	EXPECT_EQ(snapshot.at(7), 7);
+	EXPECT_EQ(map.at(7), -7);
+	EXPECT_EQ(snapshot.at(nEntries / 2), nEntries / 2);
+	EXPECT_EQ(map.at(nEntries / 2), 0);
+	EXPECT_TRUE(snapshot.contains(nEntries - 1));
+	EXPECT_FALSE(map.contains(nEntries - 1));
+
+	int expected = 0;
+	for (int value : snapshot)
+	{
+		EXPECT_EQ(value, expected++);
+	}
+	EXPECT_EQ(expected, nEntries);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_persistent_tests, randomized_against_std_map)
+{
+	using namespace __persistent_tests;
+	std::mt19937_64 rng(42);
+
+	cxpr_flux::persistent_map<std::uint64_t, std::uint64_t> map;
+	std::map<std::uint64_t, std::uint64_t> reference;
+	std::vector<std::pair<decltype(map), decltype(reference)>> snapshots;
+
+	for (int round = 0; round < 50; round++)
+	{
+		for (int i = 0; i < 500; i++)
+		{
+			// mostly small dense ids with the odd huge one so the root grows and shrinks
+			const std::uint64_t key = (rng() % 16 == 0) ? rng() : rng() % 2048;
+			if (rng() % 3 == 0)
+			{
+				EXPECT_EQ(map.erase(key), reference.erase(key) == 1);
+			}
+			else
+			{
+				EXPECT_EQ(map.set(key, i), reference.count(key) == 0);
+				reference[key] = i;
+			}
+		}
+		expect_same(map, reference);
+		snapshots.emplace_back(map, reference);
+	}
+
+	// nothing written since leaked into the older versions
+	for (const auto& [snapshot, expected] : snapshots)
+	{
+		expect_same(snapshot, expected);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_persistent_tests, collect_changes)
+{
+	std::mt19937_64 rng(7);
+
+	cxpr_flux::persistent_map<std::uint64_t, std::uint64_t> map;
+	std::map<std::uint64_t, std::uint64_t> reference;
+	for (int round = 0; round < 50; round++)
+	{
+		const auto before = map;
+		const auto referenceBefore = reference;
+		for (int i = 0; i < 50; i++)
+		{
+			const std::uint64_t key = (rng() % 16 == 0) ? rng() : rng() % 4096;
+			if (rng() % 3 == 0)
+			{
+				map.erase(key);
+				reference.erase(key);
+			}
+			else
+			{
+				// small values so some writes don't change anything
+				map.set(key, rng() % 4);
+				reference[key] = map.at(key);
+			}
+		}
+
+		cxpr_flux::flux_changeset<std::uint64_t> expected;
+		for (const auto& [key, value] : reference)
+		{
+			auto found = referenceBefore.find(key);
+			if (found == referenceBefore.end())
+			{
+				expected.inserted.push_back(key);
+			}
+			else if (found->second != value)
+			{
+				expected.updated.push_back(key);
+			}
+		}
+		for (const auto& [key, value] : referenceBefore)
+		{
+			if (reference.count(key) == 0)
+			{
+				expected.removed.push_back(key);
+			}
+		}
+
+		cxpr_flux::flux_changeset<std::uint64_t> changes;
+		map.collect_changes(before, changes);
+		EXPECT_EQ(changes.inserted, expected.inserted);
+		EXPECT_EQ(changes.removed, expected.removed);
+		EXPECT_EQ(changes.updated, expected.updated);
+	}
+
+	// the same version has no changes, an empty one has everything inserted
+	cxpr_flux::flux_changeset<std::uint64_t> changes;
+	map.collect_changes(map, changes);
+	EXPECT_TRUE(changes.empty());
+	map.collect_changes({}, changes);
+	EXPECT_EQ(changes.inserted.size(), map.size());
+
+	// signed keys come out in iteration order, as unsigned: negative ones last
+	cxpr_flux::persistent_map<int, int> signedMap;
+	for (int key : { -5, -1, 0, 3, 100 })
+	{
+		signedMap.set(key, key);
+	}
+	const auto signedBefore = signedMap;
+	signedMap.set(-2, 0);
+	signedMap.set(7, 0);
+	signedMap.set(-5, 0);
+	signedMap.set(3, 0);
+	signedMap.erase(-1);
+	signedMap.erase(100);
+
+	cxpr_flux::flux_changeset<int> signedChanges;
+	signedMap.collect_changes(signedBefore, signedChanges);
+	EXPECT_EQ(signedChanges.inserted, (std::vector<int>{ 7, -2 }));
+	EXPECT_EQ(signedChanges.updated, (std::vector<int>{ 3, -5 }));
+	EXPECT_EQ(signedChanges.removed, (std::vector<int>{ 100, -1 }));
+
+	std::vector<int> iterated;
+	for (auto it = signedMap.begin(); it != signedMap.end(); ++it)
+	{
+		iterated.push_back(it.key());
+	}
+	EXPECT_EQ(iterated, (std::vector<int>{ 0, 3, 7, -5, -2 }));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_persistent_tests, vector_basics)
+{
+	static constexpr size_t nEntries = 50000;
+
+	cxpr_flux::persistent_vector<size_t> vector;
+	for (size_t i = 0; i < nEntries; i++)
+	{
+		vector.push_back(i);
+	}
+	EXPECT_EQ(vector.size(), nEntries);
+	EXPECT_EQ(vector.front(), 0);
+	EXPECT_EQ(vector.back(), nEntries - 1);
+
+	auto snapshot = vector;
+	vector.set(10, 0);
+	vector.update(11, [](size_t& value) { value *= 2; });
+	for (size_t i = 0; i < nEntries / 2; i++)
+	{
+		vector.pop_back();
+	}
+
+	EXPECT_EQ(vector.size(), nEntries / 2);
+	EXPECT_EQ(vector.back(), nEntries / 2 - 1);
+	EXPECT_EQ(vector[10], 0);
+	EXPECT_EQ(vector[11], 22);
+	EXPECT_THROW(vector.at(nEntries / 2), std::out_of_range);
+
+	size_t expected = 0;
+	for (size_t value : snapshot)
+	{
+		EXPECT_EQ(value, expected++);
+	}
+	EXPECT_EQ(expected, nEntries);
+}
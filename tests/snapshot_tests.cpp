@@ -0,0 +1,143 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <cxpr_flux.h>
+#include "todo_classes.h"
+
+//////////////////////////////////////////////////////////////////////////
+
+using namespace cxpr;
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_snapshot_tests, copy_on_write_test)
+{
+	cxpr_flux::flux_state<std::vector<int>> state;
+	state.write().push_back(1);
+
+	{	// nobody holds a snapshot, writes go straight to the current version
+		state.write().push_back(2);
+		state.write()[0] = 3;
+		EXPECT_EQ(state.read()[0], 3);
+	}
+
+	// snapshots share the current version
+	const std::vector<int>* current = &state.read();
+	auto first = state.snapshot();
+	auto second = first;
+	EXPECT_EQ(&first.get(), current);
+	EXPECT_TRUE(first.shares(second));
+
+	// writing while a snapshot is out copies once, the snapshot keeps the old version
+	state.write().push_back(4);
+	EXPECT_NE(&state.read(), current);
+	EXPECT_EQ(first->size(), 2);
+	EXPECT_EQ(state.read().size(), 3);
+	const std::vector<int>* copied = &state.read();
+	state.write().push_back(5);
+	EXPECT_EQ(&state.read(), copied);
+
+	// empty snapshots read as a default state
+	cxpr_flux::flux_snapshot<std::vector<int>> empty;
+	EXPECT_TRUE(empty->empty());
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace history_test
+{
+	namespace signals
+	{
+		struct record
+		{
+			int value;
+		};
+	}
+
+	// Publishes its state as a flux_snapshot, containers share it instead of copying
+	struct HistoryStore : public cxpr_flux::flux_store<HistoryStore>
+	{
+		using cxpr_flux::flux_store<HistoryStore>::flux_store;
+		using state_t = std::vector<int>;
+
+		static constexpr decltype(auto) GetCallbacks()
+		{
+			return std::make_tuple
+			(
+				cxpr_flux::make_callback<signals::record>
+				(
+					[](HistoryStore& self, const signals::record& changes, auto& context)
+					{
+						self.history.write().push_back(changes.value);
+						self.emitChanged();
+						return true;
+					}
+				)
+			);
+		}
+
+		cxpr_flux::flux_snapshot<state_t> getState() const { return history.snapshot(); }
+
+	private:
+		cxpr_flux::flux_state<state_t> history;
+	};
+}
+
+TEST(flux_snapshot_tests, container_shares_snapshot_test)
+{
+	using namespace history_test;
+	static_assert(std::is_same_v<cxpr_flux::__detail::published_state_t<HistoryStore>, cxpr_flux::flux_snapshot<std::vector<int>>>);
+
+	cxpr_flux::flux_static_context<std::allocator<void>, HistoryStore> ctx;
+	auto store = ctx.getStores().createStore<HistoryStore>();
+	cxpr_flux::flux_container<HistoryStore> container;
+	container.bindExisting(*store);
+	for (int i = 0; i < 1000; i++)
+	{
+		ctx.getDispatcher().signal(signals::record{ i });
+	}
+	ctx.processSignals();
+
+	// the container hands out the store's own version
+	auto snapshot = container.getSnapshot<HistoryStore>();
+	EXPECT_TRUE(snapshot.shares(store->getState()));
+	EXPECT_EQ(&container.getState<HistoryStore>(), &snapshot.get());
+	EXPECT_EQ(snapshot->size(), 1000);
+
+	// the next change copies once, the old snapshot is left as it was
+	ctx.getDispatcher().signal(signals::record{ 1000 });
+	ctx.processSignals();
+	EXPECT_FALSE(snapshot.shares(container.getSnapshot<HistoryStore>()));
+	EXPECT_EQ(snapshot->size(), 1000);
+	EXPECT_EQ(container.getState<HistoryStore>().size(), 1001);
+	EXPECT_EQ(container.getState<HistoryStore>().back(), 1000);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_snapshot_tests, container_shares_state_test)
+{
+	using namespace todo_test;
+	cxpr_flux::flux_static_context<std::allocator<void>, TodoStore> ctx;
+	auto appContainer = cxpr_flux::create_container_view<AppContainer, AppView>(ctx);
+
+	for (int i = 0; i < 1000; i++)
+	{
+		ctx.getDispatcher().signal(signals::addTodo{ std::to_string(i) });
+	}
+	ctx.processSignals();
+
+	// the container and everything it hands out share the store's own state
+	auto state = appContainer.GetState();
+	EXPECT_TRUE(state.states.shares(appContainer.getSnapshot<TodoStore>()));
+	EXPECT_TRUE(state.states.shares(appContainer.getState<TodoStore>()));
+	EXPECT_EQ(state.states.size(), 1000);
+
+	// the next change copies the path to the todo, the old snapshot is left as it was
+	ctx.getDispatcher().signal(signals::toggleTodo{ 0 });
+	ctx.processSignals();
+	EXPECT_FALSE(state.states.shares(appContainer.getSnapshot<TodoStore>()));
+	EXPECT_FALSE(state.states.at(0).complete);
+	EXPECT_TRUE(appContainer.getState<TodoStore>().at(0).complete);
+}
@@ -0,0 +1,94 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <cxpr_flux.h>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+
+using namespace cxpr;
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_spinlock_tests, mutual_exclusion)
+{
+	static constexpr int nThreads = 8;
+	static constexpr int nIncrements = 20000;
+
+	cxpr_flux::flux_spinlock lock;
+	__int64 counter = 0; // deliberately not atomic
+	std::vector<std::thread> threads;
+	for (int thread_idx = 0; thread_idx < nThreads; thread_idx++)
+	{
+		threads.emplace_back([&lock, &counter, thread_idx]
+		{
+			for (int i = 0; i < nIncrements; i++)
+			{
+				if (thread_idx % 2 == 0)
+				{
+					auto ll = lock.scoped_lock();
+					counter++;
+				}
+				else
+				{	// works with the standard lock helpers too
+					std::lock_guard<cxpr_flux::flux_spinlock> ll(lock);
+					counter++;
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	EXPECT_EQ(counter, nThreads * nIncrements);
+	const auto stats = lock.stats();
+	EXPECT_EQ(stats.acquisitions, nThreads * nIncrements);
+	EXPECT_LE(stats.parked, stats.contended);
+	EXPECT_GE(stats.sleeps, stats.parked);
+	EXPECT_LE(stats.contended, stats.acquisitions);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_spinlock_tests, parks_past_spin_budget)
+{
+	cxpr_flux::flux_spinlock lock(cxpr_flux::SpinlockLocked);
+	EXPECT_FALSE(lock.try_lock());
+
+	// held well past the spin budget, the waiter has to go to sleep until unlock wakes it
+	std::atomic_bool acquired{ false };
+	const std::clock_t cpuStart = std::clock();
+	std::thread waiter([&]
+	{
+		auto ll = lock.scoped_lock();
+		acquired = true;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	EXPECT_FALSE(acquired);
+#if !defined(_MSC_VER) // msvc's clock() is wall time
+	// a busy waiter would have burnt about as much cpu as we slept
+	EXPECT_LT(std::clock() - cpuStart, CLOCKS_PER_SEC / 20);
+#endif
+	lock.unlock();
+	waiter.join();
+	EXPECT_TRUE(acquired);
+
+	// one sleep, give or take a spurious wakeup, rather than a loop of them
+	const auto stats = lock.stats();
+	EXPECT_EQ(stats.contended, 1);
+	EXPECT_EQ(stats.parked, 1);
+	EXPECT_GE(stats.sleeps, 1);
+	EXPECT_LE(stats.sleeps, 3);
+
+	lock.reset_stats();
+	EXPECT_TRUE(lock.try_lock());
+	lock.unlock();
+	EXPECT_EQ(lock.stats().acquisitions, 1);
+	EXPECT_EQ(lock.stats().contended, 0);
+}
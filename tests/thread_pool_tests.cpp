@@ -0,0 +1,57 @@
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include <cxpr_flux.h>
+
+//////////////////////////////////////////////////////////////////////////
+
+using namespace cxpr;
+
+//////////////////////////////////////////////////////////////////////////
+
+TEST(flux_thread_pool_tests, parallel_for_test)
+{
+	static constexpr size_t nTasks = 1000;
+	cxpr_flux::flux_thread_pool pool(4);
+
+	std::vector<int> visited(nTasks, 0);
+	std::atomic_int total{ 0 };
+	pool.parallel_for(nTasks, [&](size_t i)
+	{
+		visited[i]++;
+		// nested fork-join, the waiting task helps run the inner tasks
+		pool.parallel_for(4, [&](size_t j) { total += static_cast<int>(j); });
+	});
+
+	for (const auto v : visited)
+	{
+		EXPECT_EQ(v, 1);
+	}
+	EXPECT_EQ(total, static_cast<int>(nTasks * 6));
+}
+
+TEST(flux_thread_pool_tests, drains_on_destruction)
+{
+	static constexpr int nTasks = 100;
+	std::atomic_int nRun{ 0 };
+	std::atomic_bool release{ false };
+	{
+		cxpr_flux::flux_thread_pool pool(1);
+		// the only worker is held up, so everything after it is still queued when the pool goes
+		pool.submit([&] 
+		{ 
+			while (!release)
+			{
+				std::this_thread::yield();
+			}
+			nRun++;
+		});
+		for (int i = 0; i < nTasks; i++)
+		{
+			pool.submit([&] { nRun++; });
+		}
+		release = true;
+	}
+	EXPECT_EQ(nRun, nTasks + 1);
+}
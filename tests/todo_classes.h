@@ -41,9 +41,15 @@ namespace todo_test
 			int id;
 			bool complete;
 			std::string text;
+
+			bool operator==(const todoState& other) const
+			{
+				return id == other.id && complete == other.complete && text == other.text;
+			}
 		};
 
-		using state_t = std::vector<todoState>;
+		// keyed by id, so toggles/deletes are lookups and snapshots share everything unchanged
+		using state_t = cxpr_flux::persistent_map<int, todoState>;
 
 		static constexpr decltype(auto) GetCallbacks()
 		{
@@ -78,7 +84,7 @@ namespace todo_test
 			);
 		}
 
-		state_t getState() const { return todos; }
+		const state_t& getState() const { return todos; }
 
 	private:
 		void newTodo(const signals::addTodo& changes)
@@ -87,24 +93,19 @@ namespace todo_test
 			newState.text = changes.text;
 			newState.complete = false;
 			newState.id = counter++;
-			todos.push_back(std::move(newState));
+			todos.set(newState.id, std::move(newState));
 			emitChanged();
 		}
 
 		void deleteTodo(const signals::deleteTodo& changes)
 		{
-			todos.erase(std::find_if(std::begin(todos), std::end(todos), [&](const auto& it) { return it.id == changes.id; }));
+			todos.erase(changes.id);
 			emitChanged();
 		}
 
 		void toggleTodo(const signals::toggleTodo& changes)
 		{
-			auto found = std::find_if(std::begin(todos), std::end(todos), [&](const auto& it) { return it.id == changes.id; });
-			if (found != std::end(todos))
-			{
-				found->complete = !found->complete;
-
-			}
+			todos.update(changes.id, [](todoState& found) { found.complete = !found.complete; });
 			emitChanged();
 		}
 
@@ -116,7 +117,7 @@ namespace todo_test
 	// Current state of the system as well as type-erased callbacks needed to interact with the context
 	struct ContainerState
 	{
-		std::vector<TodoStore::todoState> states;
+		TodoStore::state_t states;
 		cxpr_flux::flux_callback<void(int)> onToggle;
 		cxpr_flux::flux_callback<void(int)> onDelete;
 	};
@@ -141,15 +142,29 @@ namespace todo_test
 			onToggle = inState.onToggle;
 			onDelete = inState.onDelete;
 
-			const std::vector<TodoStore::todoState>& stateData = inState.states;
+			const TodoStore::state_t& stateData = inState.states;
 			for (const auto& it : stateData)
 			{
-				viewData view = {};
-				view.complete = it.complete;
-				view.text = it.text;
-				view.onToggle.bind_lambda([id = it.id, this]{ this->onToggle(id); });
-				view.onDelete.bind_lambda([id = it.id, this]{ this->onDelete(id); });
-				views.emplace_back(std::move(view));
+				views.emplace_back(makeView(it));
+			}
+		}
+
+		// Brings the rows up to date by only touching the todos in changes, rows stay in id order
+		// (todo ids are never negative, so that's also the order the state and changes come in)
+		template <typename containter_state_t, typename changeset_t>
+		void Patch(const containter_state_t& inState, const changeset_t& changes)
+		{
+			for (int id : changes.removed)
+			{
+				views.erase(findView(id));
+			}
+			for (int id : changes.updated)
+			{
+				*findView(id) = makeView(inState.states.at(id));
+			}
+			for (int id : changes.inserted)
+			{
+				views.insert(findView(id), makeView(inState.states.at(id)));
 			}
 		}
 
@@ -157,6 +172,23 @@ namespace todo_test
 
 		cxpr_flux::flux_callback<void(int)> onToggle;
 		cxpr_flux::flux_callback<void(int)> onDelete;
+
+	private:
+		viewData makeView(const TodoStore::todoState& todo)
+		{
+			viewData view = {};
+			view.id = todo.id;
+			view.complete = todo.complete;
+			view.text = todo.text;
+			view.onToggle.bind_lambda([id = todo.id, this]{ this->onToggle(id); });
+			view.onDelete.bind_lambda([id = todo.id, this]{ this->onDelete(id); });
+			return view;
+		}
+
+		decltype(auto) findView(int id)
+		{
+			return std::lower_bound(std::begin(views), std::end(views), id, [](const viewData& view, int id) { return view.id < id; });
+		}
 	};
 
 	//////////////////////////////////////////////////////////////////////////
@@ -187,15 +219,24 @@ namespace todo_test
 				);
 			});
 
-			created.states = getState<TodoStore>();
+			created.states = getSnapshot<TodoStore>();
 			return created;
 		}
 
 		[[nodiscard]] view_t Render()
 		{
+			// a fresh view has everything, Update only needs what changes after this
+			resetChanges<TodoStore>();
 			return view_t(GetState());
 		}
 
+		// Patches a view made by Render with whatever changed since, instead of rebuilding it
+		void Update(view_t& view)
+		{
+			view.Patch(GetState(), getChanges<TodoStore>());
+			resetChanges<TodoStore>();
+		}
+
 	private:
 		context_t& context;
 	};